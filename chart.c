@@ -0,0 +1,110 @@
+#include "chart.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "screen.h"
+
+// Glyphs of a bar, from an empty column to a full one in CHART_STEPS, and of
+// a sparkline, from the lowest value to the highest
+static const char *const unicodeBar[CHART_STEPS + 1] = {
+    " ", "▏", "▎", "▍", "▌", "▋", "▊", "▉", "█"};
+static const char *const unicodeSpark[CHART_STEPS + 1] = {
+    " ", "▁", "▂", "▃", "▄", "▅", "▆", "▇", "█"};
+static const char asciiBar[] = " .:-=+*##";
+static const char asciiSpark[] = " .:-=+*#%";
+
+// A bar of CHART_WIDTH columns is full columns, one partial column and blank
+// ones. slices[p] holds CHART_WIDTH full columns, partial glyph p and
+// CHART_WIDTH blanks, so every bar is the CHART_WIDTH cells starting
+// CHART_WIDTH - full into one of them and takes a single copy.
+static Cell slices[CHART_STEPS][2 * CHART_WIDTH + 1];
+static Cell sparkGlyphs[CHART_STEPS + 1];
+
+// Helper function that returns the cell of a UTF-8 character.
+static Cell utf8Cell(const char *text) {
+  Cell cell = 0;
+  for (int i = 0; text[i] != '\0' && i < 4; i++) {
+    cell |= (Cell)(unsigned char)text[i] << (8 * i);
+  }
+  return cell;
+}
+
+// Helper function that returns 1 if the locale picked by the environment
+// encodes text as UTF-8.
+static int utf8Locale() {
+  const char *names[] = {"LC_ALL", "LC_CTYPE", "LANG"};
+  for (int i = 0; i < 3; i++) {
+    const char *value = getenv(names[i]);
+    if (value != NULL && *value != '\0') {
+      return strstr(value, "UTF-8") != NULL || strstr(value, "utf8") != NULL;
+    }
+  }
+  return 0;
+}
+
+// Function to build the glyphs of the charts, block characters when the
+// terminal takes UTF-8 and ASCII otherwise.
+void initCharts() {
+  int unicode = utf8Locale();
+  Cell glyphs[CHART_STEPS + 1];
+  for (int step = 0; step <= CHART_STEPS; step++) {
+    glyphs[step] = unicode ? utf8Cell(unicodeBar[step])
+                           : (Cell)(unsigned char)asciiBar[step];
+    sparkGlyphs[step] = unicode ? utf8Cell(unicodeSpark[step])
+                                : (Cell)(unsigned char)asciiSpark[step];
+  }
+  for (int p = 0; p < CHART_STEPS; p++) {
+    for (int i = 0; i < CHART_WIDTH; i++) {
+      slices[p][i] = glyphs[CHART_STEPS];
+      slices[p][CHART_WIDTH + 1 + i] = ' ';
+    }
+    slices[p][CHART_WIDTH] = glyphs[p];
+  }
+}
+
+// Helper function that returns how many steps of count a value is worth on
+// a scale from 0 to max.
+static int chartSteps(double value, double max, int count) {
+  if (!(value > 0) || !(max > 0)) {
+    return 0;
+  }
+  double steps = value / max * count + 0.5;
+  return steps >= count ? count : (int)steps;
+}
+
+// Function to draw a bar of CHART_WIDTH columns at the cursor, filled in
+// proportion to value on a scale from 0 to max.
+void drawBar(double value, double max) {
+  int steps = chartSteps(value, max, CHART_WIDTH * CHART_STEPS);
+  int full = steps / CHART_STEPS;
+  drawCells(&slices[steps % CHART_STEPS][CHART_WIDTH - full], CHART_WIDTH);
+}
+
+// Function to draw only the filled columns of the same bar, so what follows
+// it is drawn right after them.
+void drawBarFill(double value, double max) {
+  int steps = chartSteps(value, max, CHART_WIDTH * CHART_STEPS);
+  int full = steps / CHART_STEPS;
+  drawCells(&slices[steps % CHART_STEPS][CHART_WIDTH - full],
+            full + (steps % CHART_STEPS != 0));
+}
+
+// Function to draw the last CHART_WIDTH values of a history column at the
+// cursor on a scale from 0 to max, one column per sample with the newest on
+// the right. Only values of 0 and below are blank.
+void drawSparkline(const HistoryRing *ring, int column, double max) {
+  Cell line[CHART_WIDTH];
+  size_t shown = ring->count < CHART_WIDTH ? ring->count : CHART_WIDTH;
+  size_t blank = CHART_WIDTH - shown;
+  for (size_t i = 0; i < blank; i++) {
+    line[i] = ' ';
+  }
+  for (size_t i = 0; i < shown; i++) {
+    double value = historyValue(ring, column, ring->count - shown + i);
+    line[blank + i] =
+        sparkGlyphs[value > 0 ? 1 + chartSteps(value, max, CHART_STEPS - 1)
+                              : 0];
+  }
+  drawCells(line, CHART_WIDTH);
+}
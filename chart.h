@@ -0,0 +1,14 @@
+#ifndef CHART_H
+#define CHART_H
+
+#include "history.h"
+
+#define CHART_WIDTH 50  // Columns of a bar or a sparkline
+#define CHART_STEPS 8   // Steps a bar resolves within one column
+
+// Function prototypes
+void initCharts();
+void drawBar(double value, double max);
+void drawBarFill(double value, double max);
+void drawSparkline(const HistoryRing *ring, int column, double max);
+#endif  // CHART_H
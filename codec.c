@@ -0,0 +1,194 @@
+#include "codec.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Helper functions mapping signed values to unsigned ones with small
+// magnitudes staying small.
+static uint64_t zigzag(int64_t value) {
+  return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static int64_t unzigzag(uint64_t value) {
+  return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+// Helper function to write a value 7 bits per byte, low bits first.
+static uint8_t *putVarint(uint8_t *out, uint64_t value) {
+  while (value >= 0x80) {
+    *out++ = (uint8_t)value | 0x80;
+    value >>= 7;
+  }
+  *out++ = (uint8_t)value;
+  return out;
+}
+
+// Helper function to read a varint, returns NULL when it runs past end.
+static const uint8_t *getVarint(const uint8_t *in, const uint8_t *end,
+                                uint64_t *value) {
+  uint64_t result = 0;
+  for (int shift = 0; in < end && shift < 64; shift += 7) {
+    uint8_t byte = *in++;
+    result |= (uint64_t)(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      *value = result;
+      return in;
+    }
+  }
+  return NULL;
+}
+
+// Helper function that returns the buffer holding the last record of a type,
+// sized for length bytes of payload. fresh is set when there is no earlier
+// record of the same length to encode against, the payload then counts as
+// zeros.
+static RecordHeader *lastRecord(CodecState *state, uint32_t type,
+                                uint32_t length, int *fresh) {
+  RecordHeader *last = state->last[type];
+  *fresh = !(state->valid & 1u << type) || last->length != length;
+  size_t size = sizeof(RecordHeader) + length;
+  if (state->capacity[type] < size) {
+    last = realloc(last, size);
+    if (last == NULL) {
+      perror("realloc");
+      exit(EXIT_FAILURE);
+    }
+    state->last[type] = last;
+    state->capacity[type] = size;
+  }
+  return last;
+}
+
+// Function to set up an empty state.
+void initCodec(CodecState *state) {
+  memset(state, 0, sizeof(*state));
+}
+
+// Function to forget everything encoded so far, the next record is encoded
+// on its own. Buffers are kept, and so are earlier decoded records.
+void resetCodec(CodecState *state) {
+  state->timestamp_ns = 0;
+  state->delta_ns = 0;
+  state->tick = 0;
+  state->records = 0;
+  state->valid = 0;
+}
+
+// Function to release the buffers of a state.
+void freeCodec(CodecState *state) {
+  for (int type = 0; type < CODEC_TYPES; type++) {
+    free(state->last[type]);
+  }
+  initCodec(state);
+}
+
+// Function that returns the most bytes a record with length bytes of payload
+// can take encoded.
+size_t codecBound(uint32_t length) {
+  return 1 + 4 * 10 + length / 8 * 10 + length % 8;
+}
+
+// Function to encode a record into out, which holds codecBound() bytes.
+// Returns the number of bytes written.
+size_t encodeRecord(CodecState *state, const RecordHeader *record,
+                    uint8_t *out) {
+  uint8_t *cursor = out;
+  if (state->records == CODEC_BLOCK_RECORDS) {
+    resetCodec(state);
+  }
+  if (state->records == 0) {
+    *cursor++ = CODEC_RESET;
+  }
+
+  int64_t delta_ns = record->timestamp_ns - state->timestamp_ns;
+  cursor = putVarint(cursor, record->type);
+  cursor = putVarint(cursor, zigzag((int64_t)record->tick - state->tick));
+  cursor = putVarint(cursor, zigzag(delta_ns - state->delta_ns));
+  cursor = putVarint(cursor, record->length);
+
+  int fresh;
+  RecordHeader *last =
+      lastRecord(state, record->type, record->length, &fresh);
+  const uint8_t *payload = (const uint8_t *)(record + 1);
+  const uint8_t *prev = (const uint8_t *)(last + 1);
+  size_t words = record->length / 8;
+  for (size_t i = 0; i < words; i++) {
+    uint64_t word, prevWord = 0;
+    memcpy(&word, payload + i * 8, 8);
+    if (!fresh) {
+      memcpy(&prevWord, prev + i * 8, 8);
+    }
+    cursor = putVarint(cursor, zigzag((int64_t)(word - prevWord)));
+  }
+  for (size_t i = words * 8; i < record->length; i++) {
+    *cursor++ = payload[i] ^ (fresh ? 0 : prev[i]);
+  }
+
+  memcpy(last, record, sizeof(RecordHeader) + record->length);
+  state->timestamp_ns = record->timestamp_ns;
+  state->delta_ns = delta_ns;
+  state->tick = record->tick;
+  state->records++;
+  state->valid |= 1u << record->type;
+  return cursor - out;
+}
+
+// Function to decode the record at the start of in, setting used to the
+// bytes it took. Returns NULL if in holds no complete record. The record is
+// kept in the state and stays valid until the next record of its type.
+const RecordHeader *decodeRecord(CodecState *state, const uint8_t *in,
+                                 size_t size, size_t *used) {
+  const uint8_t *cursor = in, *end = in + size;
+  if (cursor < end && *cursor == CODEC_RESET) {
+    resetCodec(state);
+    cursor++;
+  }
+
+  uint64_t type, tick, deltaChange, length;
+  if ((cursor = getVarint(cursor, end, &type)) == NULL || type == 0 ||
+      type >= CODEC_TYPES ||
+      (cursor = getVarint(cursor, end, &tick)) == NULL ||
+      (cursor = getVarint(cursor, end, &deltaChange)) == NULL ||
+      (cursor = getVarint(cursor, end, &length)) == NULL ||
+      length / 8 + length % 8 > (uint64_t)(end - cursor)) {
+    return NULL;  // Every word takes at least one byte
+  }
+
+  int fresh;
+  RecordHeader *last = lastRecord(state, type, length, &fresh);
+  uint8_t *payload = (uint8_t *)(last + 1);
+  size_t words = length / 8;
+  for (size_t i = 0; i < words; i++) {
+    uint64_t change, word = 0;
+    if ((cursor = getVarint(cursor, end, &change)) == NULL) {
+      state->valid &= ~(1u << type);  // Half decoded, can't be used again
+      return NULL;
+    }
+    if (!fresh) {
+      memcpy(&word, payload + i * 8, 8);
+    }
+    word += (uint64_t)unzigzag(change);
+    memcpy(payload + i * 8, &word, 8);
+  }
+  if ((uint64_t)(end - cursor) < length % 8) {
+    state->valid &= ~(1u << type);
+    return NULL;
+  }
+  for (size_t i = words * 8; i < length; i++) {
+    payload[i] = *cursor++ ^ (fresh ? 0 : payload[i]);
+  }
+
+  state->delta_ns += unzigzag(deltaChange);
+  state->timestamp_ns += state->delta_ns;
+  state->tick += unzigzag(tick);
+  state->records++;
+  state->valid |= 1u << type;
+  last->type = type;
+  last->length = length;
+  last->tick = state->tick;
+  last->reserved = 0;
+  last->timestamp_ns = state->timestamp_ns;
+  *used = cursor - in;
+  return last;
+}
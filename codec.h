@@ -0,0 +1,39 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "collectors.h"
+
+#define CODEC_TYPES 8            // Record types with their own history
+#define CODEC_BLOCK_RECORDS 256  // Records between two resets of the state
+#define CODEC_RESET 0            // Type byte starting a new block
+
+// State shared by the encoder and the decoder of a record stream. Timestamps
+// are stored as the change of their delta, record payloads as 8 byte words
+// minus the word of the previous record of the same type, both zigzag and
+// varint encoded. Raw /proc counters only grow by a little every sample, so
+// most words take one or two bytes. The state is reset at the start of every
+// block so decoding can start at any block.
+typedef struct {
+  int64_t timestamp_ns;
+  int64_t delta_ns;
+  int32_t tick;
+  uint32_t records;  // Records since the last reset
+  uint32_t valid;    // Bit n set when last[n] can be encoded against
+  // Last record of every type, header included
+  RecordHeader *last[CODEC_TYPES];
+  size_t capacity[CODEC_TYPES];
+} CodecState;
+
+// Function prototypes
+void initCodec(CodecState *state);
+void resetCodec(CodecState *state);
+void freeCodec(CodecState *state);
+size_t codecBound(uint32_t length);
+size_t encodeRecord(CodecState *state, const RecordHeader *record,
+                    uint8_t *out);
+const RecordHeader *decodeRecord(CodecState *state, const uint8_t *in,
+                                 size_t size, size_t *used);
+#endif  // CODEC_H
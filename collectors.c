@@ -0,0 +1,358 @@
+#include "collectors.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define READ_END 0
+#define WRITE_END 1
+#define MAX_COLLECTORS 8
+#define MAX_RECORD_LENGTH (64 * 1024 * 1024)
+
+// Collectors with open pipes, so a new child can close the ends it inherited
+// from the parent. Otherwise a persistent child would keep another child's
+// control pipe open and neither would ever see end of file.
+static Collector *active[MAX_COLLECTORS];
+
+// Accumulated cost of the collection phase of every tick.
+static long costTicks = 0;
+static double costWallUs = 0;
+static double tickStartUs = 0;
+static double cpuStartUs = -1;
+
+// Helper function that returns the current monotonic time in microseconds.
+static double nowUs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// Helper function that returns user + system time of the monitor and all of
+// its reaped children in microseconds.
+static double cpuUs() {
+  struct rusage self, children;
+  getrusage(RUSAGE_SELF, &self);
+  getrusage(RUSAGE_CHILDREN, &children);
+  return (self.ru_utime.tv_sec + self.ru_stime.tv_sec +
+          children.ru_utime.tv_sec + children.ru_stime.tv_sec) *
+             1e6 +
+         self.ru_utime.tv_usec + self.ru_stime.tv_usec +
+         children.ru_utime.tv_usec + children.ru_stime.tv_usec;
+}
+
+static void addActive(Collector *collector) {
+  for (int i = 0; i < MAX_COLLECTORS; i++) {
+    if (active[i] == NULL || active[i] == collector) {
+      active[i] = collector;
+      return;
+    }
+  }
+}
+
+static void removeActive(Collector *collector) {
+  for (int i = 0; i < MAX_COLLECTORS; i++) {
+    if (active[i] == collector) {
+      active[i] = NULL;
+    }
+  }
+}
+
+// Close every parent side pipe end inherited by a freshly forked child.
+static void closeInherited() {
+  for (int i = 0; i < MAX_COLLECTORS; i++) {
+    if (active[i] == NULL) {
+      continue;
+    }
+    if (active[i]->dataFd != -1) {
+      close(active[i]->dataFd);
+    }
+    if (active[i]->controlFd != -1) {
+      close(active[i]->controlFd);
+    }
+  }
+}
+
+// Fork a child whose stdout is the write end of a new data pipe. In persistent
+// mode the child loops on its control pipe, running the function once per
+// tick number received.
+static void forkCollector(Collector *collector, int tick) {
+  int dataPipe[2], controlPipe[2] = {-1, -1};
+  if (pipe(dataPipe) == -1) {
+    perror("pipe");
+    exit(EXIT_FAILURE);
+  }
+  if (collector->persistent && pipe(controlPipe) == -1) {
+    perror("pipe");
+    exit(EXIT_FAILURE);
+  }
+
+  fflush(stdout);  // Don't let the child flush the parent's pending output
+  pid_t pid = fork();
+  if (pid == -1) {
+    perror("fork");
+    exit(EXIT_FAILURE);
+  } else if (pid == 0) {  // Child process
+    closeInherited();
+    close(dataPipe[READ_END]);  // Close unused read end of the pipe
+    dup2(dataPipe[WRITE_END],
+         STDOUT_FILENO);         // Redirect stdout to the write end of the pipe
+    close(dataPipe[WRITE_END]);  // Close the write end of the pipe in the child
+    if (!collector->persistent) {
+      collector->function(tick);  // Execute the function in the child process
+      exit(EXIT_SUCCESS);
+    }
+
+    // Only the parent handles Ctrl + C, the child exits when the control
+    // pipe is closed.
+    signal(SIGINT, SIG_IGN);
+    close(controlPipe[WRITE_END]);
+    while (read(controlPipe[READ_END], &tick, sizeof(tick)) == sizeof(tick)) {
+      collector->function(tick);
+    }
+    exit(EXIT_SUCCESS);
+  }
+
+  // Close unnecessary pipe ends in the parent process
+  close(dataPipe[WRITE_END]);
+  collector->pid = pid;
+  collector->dataFd = dataPipe[READ_END];
+  if (collector->persistent) {
+    close(controlPipe[READ_END]);
+    collector->controlFd = controlPipe[WRITE_END];
+  }
+  addActive(collector);
+}
+
+// Function to set up a collector, forking its child right away when
+// persistent.
+void startCollector(Collector *collector, CollectorFunction function,
+                    int persistent, int deadlineMs) {
+  collector->function = function;
+  collector->persistent = persistent;
+  collector->deadlineMs = deadlineMs;
+  collector->pid = -1;
+  collector->dataFd = -1;
+  collector->controlFd = -1;
+  collector->busy = 0;
+  collector->stale = 0;
+  collector->length = 0;
+  if (persistent) {
+    forkCollector(collector, 0);
+  }
+}
+
+// Function to start sampling one tick, either by forking a new child or by
+// waking up the persistent one. A collector still busy with an earlier tick
+// is left alone, returns whether the collector was triggered.
+int triggerCollector(Collector *collector, int tick) {
+  if (collector->busy) {
+    return 0;
+  }
+  collector->busy = 1;
+  collector->length = 0;
+  if (!collector->persistent) {
+    forkCollector(collector, tick);
+    return 1;
+  }
+  if (write(collector->controlFd, &tick, sizeof(tick)) != sizeof(tick)) {
+    perror("write");
+    exit(EXIT_FAILURE);
+  }
+  return 1;
+}
+
+// Reap the child of a fork-per-sample collector once its pipe is closed.
+static void reapCollector(Collector *collector) {
+  close(collector->dataFd);
+  collector->dataFd = -1;
+  removeActive(collector);
+  waitpid(collector->pid, NULL, 0);
+  collector->pid = -1;
+}
+
+// Function to send one record from a collector child to the parent, the
+// header and payload go out in a single write.
+void sendRecord(uint32_t type, int tick, const void *payload, size_t length) {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  RecordHeader header = {type, (uint32_t)length, tick, 0,
+                         (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec};
+
+  char stackBuffer[512];
+  char *buffer = stackBuffer;
+  size_t total = sizeof(header) + length;
+  if (total > sizeof(stackBuffer) && (buffer = malloc(total)) == NULL) {
+    perror("malloc");
+    exit(EXIT_FAILURE);
+  }
+  memcpy(buffer, &header, sizeof(header));
+  memcpy(buffer + sizeof(header), payload, length);
+
+  size_t written = 0;
+  while (written < total) {
+    ssize_t nbytes = write(STDOUT_FILENO, buffer + written, total - written);
+    if (nbytes == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("write");
+      exit(EXIT_FAILURE);
+    }
+    written += nbytes;
+  }
+  if (buffer != stackBuffer) {
+    free(buffer);
+  }
+}
+
+// Read what is available on a collector's pipe, returns 1 once a whole
+// record has been received.
+static int readCollector(Collector *collector) {
+  size_t wanted = sizeof(RecordHeader);
+  if (collector->length >= sizeof(RecordHeader)) {
+    const RecordHeader *header = (const RecordHeader *)collector->data;
+    if (header->length > MAX_RECORD_LENGTH) {
+      fprintf(stderr, "Invalid record from collector %d\n", collector->pid);
+      exit(EXIT_FAILURE);
+    }
+    wanted += header->length;
+  }
+  if (collector->capacity < wanted) {
+    collector->capacity = wanted < 4096 ? 4096 : wanted;
+    collector->data = realloc(collector->data, collector->capacity);
+    if (collector->data == NULL) {
+      perror("realloc");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  // Only one record is ever in flight on a pipe, so reading as much as fits
+  // never reaches into the next one and small records take a single read.
+  ssize_t nbytes = read(collector->dataFd, collector->data + collector->length,
+                        collector->capacity - collector->length);
+  if (nbytes == -1 && errno == EINTR) {
+    return 0;
+  }
+  if (nbytes <= 0) {
+    fprintf(stderr, "Collector %d exited without sending a sample\n",
+            collector->pid);
+    exit(EXIT_FAILURE);
+  }
+  collector->length += nbytes;
+  if (collector->length < sizeof(RecordHeader) ||
+      collector->length < sizeof(RecordHeader) +
+                              ((const RecordHeader *)collector->data)->length) {
+    return 0;
+  }
+  if (!collector->persistent) {
+    reapCollector(collector);
+  }
+  return 1;
+}
+
+// Function to wait for the samples of busy collectors, rendering each one as
+// soon as it is complete. Collectors that miss their deadline are rendered
+// stale and keep collecting, their sample is rendered on a later tick.
+void pollCollectors(Collector **collectors, int count, CollectorRender render) {
+  struct pollfd fds[MAX_COLLECTORS];
+  Collector *waiting[MAX_COLLECTORS];
+  double start = nowUs();
+
+  for (;;) {
+    int nfds = 0;
+    int timeoutMs = -1;
+    double elapsedMs = (nowUs() - start) / 1e3;
+    for (int i = 0; i < count && nfds < MAX_COLLECTORS; i++) {
+      Collector *collector = collectors[i];
+      if (!collector->busy) {
+        continue;
+      }
+      int remaining = collector->deadlineMs - (int)elapsedMs;
+      if (remaining <= 0) {
+        if (!collector->stale) {
+          collector->stale = 1;
+          render(collector, NULL);
+        }
+        continue;
+      }
+      if (timeoutMs == -1 || remaining < timeoutMs) {
+        timeoutMs = remaining;
+      }
+      fds[nfds].fd = collector->dataFd;
+      fds[nfds].events = POLLIN;
+      waiting[nfds++] = collector;
+    }
+    if (nfds == 0) {
+      return;
+    }
+
+    if (poll(fds, nfds, timeoutMs) == -1) {
+      if (errno == EINTR) {
+        continue;  // Interrupted by Ctrl + C
+      }
+      perror("poll");
+      exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < nfds; i++) {
+      if (fds[i].revents == 0) {
+        continue;
+      }
+      Collector *collector = waiting[i];
+      if (readCollector(collector)) {
+        collector->busy = 0;
+        render(collector, (const RecordHeader *)collector->data);
+        collector->stale = 0;
+      }
+    }
+  }
+}
+
+// Function to shut a collector down and reap its child.
+void stopCollector(Collector *collector) {
+  free(collector->data);
+  collector->data = NULL;
+  collector->capacity = 0;
+  if (collector->pid <= 0) {
+    return;
+  }
+  if (collector->persistent) {
+    close(collector->controlFd);  // The child exits on end of file
+    collector->controlFd = -1;
+  } else {
+    kill(collector->pid, SIGKILL);  // Still busy past its deadline
+  }
+  reapCollector(collector);
+}
+
+// Function to mark the start of the collection phase of a tick.
+void beginCollectorTick() {
+  if (cpuStartUs < 0) {
+    cpuStartUs = cpuUs();
+  }
+  tickStartUs = nowUs();
+}
+
+// Function to mark the end of the collection phase of a tick.
+void endCollectorTick() {
+  costWallUs += nowUs() - tickStartUs;
+  costTicks++;
+}
+
+// Function to print the average cost of a tick. Persistent collectors must
+// be stopped first so the CPU time of their children has been accounted.
+void printCollectorCost(int persistent) {
+  if (costTicks == 0) {
+    return;
+  }
+  printf("Collector cost (%s): %.0f us wall, %.0f us cpu per tick\n",
+         persistent ? "persistent" : "fork per sample", costWallUs / costTicks,
+         (cpuUs() - cpuStartUs) / costTicks);
+}
@@ -0,0 +1,63 @@
+#ifndef COLLECTORS_H
+#define COLLECTORS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// Record types sent over the collector pipes
+#define RECORD_MEMORY 1
+#define RECORD_USERS 2
+#define RECORD_CPU 3
+#define RECORD_SYSTEM 4
+#define RECORD_PROCESSES 5
+
+// Every sample travels as a fixed header followed by length bytes of payload,
+// written with a single write().
+typedef struct {
+  uint32_t type;
+  uint32_t length;
+  int32_t tick;
+  int32_t reserved;
+  int64_t timestamp_ns;  // CLOCK_REALTIME when the sample was taken
+} RecordHeader;
+
+// Function run inside a collector child, sends its sample with sendRecord.
+typedef void (*CollectorFunction)(int tick);
+
+// A collector runs one sampling function in a child process and sends the
+// output back to the parent over a pipe. In fork-per-sample mode a new child
+// is forked every tick, in persistent mode the child is forked once and is
+// triggered every tick by writing the tick number on its control pipe. Either
+// way the child answers with one binary record per tick.
+typedef struct {
+  CollectorFunction function;
+  int persistent;
+  int deadlineMs;  // Time after the start of a tick before it is shown stale
+  int row;         // Screen row the sample is rendered at
+  pid_t pid;
+  int dataFd;     // Read end of the data pipe in the parent
+  int controlFd;  // Write end of the control pipe, -1 when forking per sample
+  int busy;       // Set while a sample is being collected
+  int stale;      // Set when the last sample missed its deadline
+  char *data;     // Record being received, starts with a RecordHeader
+  size_t length;
+  size_t capacity;
+} Collector;
+
+// Called with the complete record of a sample, its payload follows the
+// header, or with NULL when the collector missed its deadline.
+typedef void (*CollectorRender)(Collector *collector,
+                                const RecordHeader *record);
+
+// Function prototypes
+void startCollector(Collector *collector, CollectorFunction function,
+                    int persistent, int deadlineMs);
+int triggerCollector(Collector *collector, int tick);
+void pollCollectors(Collector **collectors, int count, CollectorRender render);
+void stopCollector(Collector *collector);
+void sendRecord(uint32_t type, int tick, const void *payload, size_t length);
+void beginCollectorTick();
+void endCollectorTick();
+void printCollectorCost(int persistent);
+#endif  // COLLECTORS_H
@@ -0,0 +1,281 @@
+#include "format.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define FORMAT_BUFFER 65536
+#define FORMAT_LINE 512  // Longest line a tick makes
+
+// Fields of every line, in order. The names are the CSV header and the JSON
+// keys, and never change meaning once released.
+enum {
+  FIELD_TIMESTAMP,
+  FIELD_TICK,
+  FIELD_CPU_BUSY,
+  FIELD_CPU_IOWAIT,
+  FIELD_CPU_STEAL,
+  FIELD_CPU_GUEST,
+  FIELD_MEM_TOTAL,
+  FIELD_MEM_AVAILABLE,
+  FIELD_SWAP_TOTAL,
+  FIELD_SWAP_FREE,
+  FIELD_USERS,
+  FIELDS
+};
+
+static const char *const fieldNames[FIELDS] = {
+    [FIELD_TIMESTAMP] = "timestamp_ms",
+    [FIELD_TICK] = "tick",
+    [FIELD_CPU_BUSY] = "cpu_busy",
+    [FIELD_CPU_IOWAIT] = "cpu_iowait",
+    [FIELD_CPU_STEAL] = "cpu_steal",
+    [FIELD_CPU_GUEST] = "cpu_guest",
+    [FIELD_MEM_TOTAL] = "mem_total_kb",
+    [FIELD_MEM_AVAILABLE] = "mem_available_kb",
+    [FIELD_SWAP_TOTAL] = "swap_total_kb",
+    [FIELD_SWAP_FREE] = "swap_free_kb",
+    [FIELD_USERS] = "users"};
+
+// Prometheus metric exposing a field, scale turns its unit into the base
+// unit the metric is named after. Fields without a name aren't exposed.
+typedef struct {
+  const char *name;
+  const char *help;
+  uint64_t scale;
+} Exposition;
+
+static const Exposition expositions[FIELDS] = {
+    [FIELD_CPU_BUSY] = {"sysmon_cpu_busy_percent",
+                        "Cpu time not idle, in iowait or stolen", 1},
+    [FIELD_CPU_IOWAIT] = {"sysmon_cpu_iowait_percent",
+                          "Cpu time idle waiting for io", 1},
+    [FIELD_CPU_STEAL] = {"sysmon_cpu_steal_percent",
+                         "Cpu time taken by the hypervisor", 1},
+    [FIELD_CPU_GUEST] = {"sysmon_cpu_guest_percent",
+                         "Cpu time spent running guests", 1},
+    [FIELD_MEM_TOTAL] = {"sysmon_memory_total_bytes",
+                         "Physical memory", 1024},
+    [FIELD_MEM_AVAILABLE] = {"sysmon_memory_available_bytes",
+                             "Physical memory available without swapping",
+                             1024},
+    [FIELD_SWAP_TOTAL] = {"sysmon_swap_total_bytes", "Swap space", 1024},
+    [FIELD_SWAP_FREE] = {"sysmon_swap_free_bytes", "Swap space unused", 1024},
+    [FIELD_USERS] = {"sysmon_users", "Logged in sessions", 1}};
+
+// Latest value of every field. A field keeps its value on ticks its
+// collector isn't due, and is null until its first record.
+static struct {
+  int format;
+  uint64_t integers[FIELDS];  // Fields holding counts
+  double decimals[FIELDS];    // Fields holding percentages
+  uint32_t valid;             // Bit n set once field n has a value
+  int64_t timestamp_ns;       // Newest record of the tick
+  int records;                // Records since the last line
+  char buffer[FORMAT_BUFFER];
+  size_t used;
+} output;
+
+// Helper function to write a value in decimal, without stdio or the locale.
+static char *putUnsigned(char *out, uint64_t value) {
+  char digits[20];
+  int count = 0;
+  do {
+    digits[count++] = '0' + value % 10;
+    value /= 10;
+  } while (value != 0);
+  while (count > 0) {
+    *out++ = digits[--count];
+  }
+  return out;
+}
+
+// Helper function to write a value rounded to two decimals.
+static char *putDecimal(char *out, double value) {
+  if (value < 0) {
+    *out++ = '-';
+    value = -value;
+  }
+  uint64_t hundredths = (uint64_t)(value * 100 + 0.5);
+  out = putUnsigned(out, hundredths / 100);
+  *out++ = '.';
+  *out++ = '0' + hundredths / 10 % 10;
+  *out++ = '0' + hundredths % 10;
+  return out;
+}
+
+// Function that returns the format named by a --format= value, exits when
+// there is none.
+int parseFormat(const char *name) {
+  if (strcmp(name, "jsonl") == 0) {
+    return FORMAT_JSONL;
+  }
+  if (strcmp(name, "csv") == 0) {
+    return FORMAT_CSV;
+  }
+  if (strcmp(name, "screen") == 0) {
+    return FORMAT_SCREEN;
+  }
+  fprintf(stderr, "Unknown format %s, use jsonl or csv\n", name);
+  exit(EXIT_FAILURE);
+}
+
+// Function to start writing lines in a format, CSV starts with its header.
+void startFormat(int format) {
+  output.format = format;
+  if (format != FORMAT_CSV) {
+    return;
+  }
+  char *out = output.buffer;
+  for (int field = 0; field < FIELDS; field++) {
+    size_t length = strlen(fieldNames[field]);
+    memcpy(out, fieldNames[field], length);
+    out += length;
+    *out++ = field == FIELDS - 1 ? '\n' : ',';
+  }
+  output.used = out - output.buffer;
+}
+
+// Function to take the fields a record carries, cpu records through the
+// usage already computed from them. Usage measured since boot is no usage
+// over an interval, its fields are left empty.
+void formatRecord(const RecordHeader *record, const CpuUsage *usage) {
+  const void *payload = record + 1;
+  uint32_t cpuFields = 1u << FIELD_CPU_BUSY | 1u << FIELD_CPU_IOWAIT |
+                       1u << FIELD_CPU_STEAL | 1u << FIELD_CPU_GUEST;
+  switch (record->type) {
+    case RECORD_CPU:
+      if (usage->sinceBoot) {
+        output.valid &= ~cpuFields;
+        break;
+      }
+      output.decimals[FIELD_CPU_BUSY] = usage->busy[0];
+      output.decimals[FIELD_CPU_IOWAIT] = usage->iowait[0];
+      output.decimals[FIELD_CPU_STEAL] = usage->steal[0];
+      output.decimals[FIELD_CPU_GUEST] = usage->guest[0];
+      output.valid |= cpuFields;
+      break;
+    case RECORD_MEMORY: {
+      const uint64_t *kb = ((const MemorySample *)payload)->kb;
+      output.integers[FIELD_MEM_TOTAL] = kb[MEM_TOTAL];
+      output.integers[FIELD_MEM_AVAILABLE] = kb[MEM_AVAILABLE];
+      output.integers[FIELD_SWAP_TOTAL] = kb[MEM_SWAP_TOTAL];
+      output.integers[FIELD_SWAP_FREE] = kb[MEM_SWAP_FREE];
+      output.valid |= 1u << FIELD_MEM_TOTAL | 1u << FIELD_MEM_AVAILABLE |
+                      1u << FIELD_SWAP_TOTAL | 1u << FIELD_SWAP_FREE;
+      break;
+    }
+    case RECORD_USERS:
+      output.integers[FIELD_USERS] = ((const UsersSample *)payload)->count;
+      output.valid |= 1u << FIELD_USERS;
+      break;
+    default:
+      return;  // Nothing in the schema
+  }
+  if (output.records == 0 || record->timestamp_ns > output.timestamp_ns) {
+    output.timestamp_ns = record->timestamp_ns;
+  }
+  output.records++;
+}
+
+// Function to add the line of a tick to the buffer, ticks without records
+// make no line. The buffer is written out when it can't take another line.
+void formatTick(int tick) {
+  if (output.records == 0) {
+    return;
+  }
+  if (FORMAT_BUFFER - output.used < FORMAT_LINE) {
+    flushFormat();
+  }
+  output.integers[FIELD_TIMESTAMP] = output.timestamp_ns / 1000000;
+  output.integers[FIELD_TICK] = tick;
+  output.valid |= 1u << FIELD_TIMESTAMP | 1u << FIELD_TICK;
+
+  char *out = output.buffer + output.used;
+  int json = output.format == FORMAT_JSONL;
+  if (json) {
+    *out++ = '{';
+  }
+  for (int field = 0; field < FIELDS; field++) {
+    if (json) {
+      *out++ = '"';
+      size_t length = strlen(fieldNames[field]);
+      memcpy(out, fieldNames[field], length);
+      out += length;
+      *out++ = '"';
+      *out++ = ':';
+    }
+    if (!(output.valid & 1u << field)) {
+      if (json) {
+        memcpy(out, "null", 4);
+        out += 4;
+      }
+    } else if (field >= FIELD_CPU_BUSY && field <= FIELD_CPU_GUEST) {
+      out = putDecimal(out, output.decimals[field]);
+    } else {
+      out = putUnsigned(out, output.integers[field]);
+    }
+    *out++ = field < FIELDS - 1 ? ',' : json ? '}' : '\n';
+  }
+  if (json) {
+    *out++ = '\n';
+  }
+  output.used = out - output.buffer;
+  output.records = 0;
+}
+
+// Helper function to append a string.
+static char *putText(char *out, const char *text) {
+  size_t length = strlen(text);
+  memcpy(out, text, length);
+  return out + length;
+}
+
+// Function to write the latest value of every field that has one in the
+// Prometheus text format, out holds FORMAT_EXPOSITION bytes. Percentages are
+// over the last cpu interval. Returns the length written.
+size_t formatExposition(char *out) {
+  char *start = out;
+  for (int field = 0; field < FIELDS; field++) {
+    const Exposition *metric = &expositions[field];
+    if (metric->name == NULL || !(output.valid & 1u << field)) {
+      continue;
+    }
+    out = putText(out, "# HELP ");
+    out = putText(out, metric->name);
+    *out++ = ' ';
+    out = putText(out, metric->help);
+    out = putText(out, "\n# TYPE ");
+    out = putText(out, metric->name);
+    out = putText(out, " gauge\n");
+    out = putText(out, metric->name);
+    *out++ = ' ';
+    if (field >= FIELD_CPU_BUSY && field <= FIELD_CPU_GUEST) {
+      out = putDecimal(out, output.decimals[field]);
+    } else {
+      out = putUnsigned(out, output.integers[field] * metric->scale);
+    }
+    *out++ = '\n';
+  }
+  return out - start;
+}
+
+// Function to write the buffered lines to stdout in one go.
+void flushFormat() {
+  size_t written = 0;
+  while (written < output.used) {
+    ssize_t nbytes =
+        write(STDOUT_FILENO, output.buffer + written, output.used - written);
+    if (nbytes == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("write");
+      exit(EXIT_FAILURE);
+    }
+    written += nbytes;
+  }
+  output.used = 0;
+}
@@ -0,0 +1,25 @@
+#ifndef FORMAT_H
+#define FORMAT_H
+
+#include <stddef.h>
+
+#include "collectors.h"
+#include "stats_functions.h"
+
+#define FORMAT_EXPOSITION 4096  // Most bytes formatExposition() writes
+
+// How samples reach stdout
+enum {
+  FORMAT_SCREEN,  // Drawn on the terminal
+  FORMAT_JSONL,   // One JSON object per tick
+  FORMAT_CSV      // One row per tick under a header row
+};
+
+// Function prototypes
+int parseFormat(const char *name);
+void startFormat(int format);
+void formatRecord(const RecordHeader *record, const CpuUsage *usage);
+void formatTick(int tick);
+void flushFormat();
+size_t formatExposition(char *out);
+#endif  // FORMAT_H
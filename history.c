@@ -0,0 +1,104 @@
+#include "history.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Function that returns how many samples of the given width fit in budget
+// bytes, at least one.
+size_t historyCapacity(int columns, size_t budget) {
+  size_t perSample = sizeof(int64_t) + columns * sizeof(double);
+  size_t capacity = budget / perSample;
+  return capacity > 0 ? capacity : 1;
+}
+
+// Function that returns the bytes held by a ring.
+size_t historyBytes(const HistoryRing *ring) {
+  return ring->capacity * (sizeof(int64_t) + ring->columns * sizeof(double));
+}
+
+// Function to allocate a ring holding capacity samples of columns values.
+void initHistory(HistoryRing *ring, int columns, size_t capacity) {
+  ring->columns = columns;
+  ring->capacity = capacity;
+  ring->count = 0;
+  ring->next = 0;
+  ring->timestamp_ns = malloc(capacity * sizeof(int64_t));
+  ring->values = malloc(capacity * columns * sizeof(double));
+  if (ring->timestamp_ns == NULL || ring->values == NULL) {
+    perror("malloc");
+    exit(EXIT_FAILURE);
+  }
+}
+
+// Function to store one sample, row holds one value per column. The oldest
+// sample is dropped once the ring is full.
+void appendHistory(HistoryRing *ring, int64_t timestamp_ns,
+                   const double *row) {
+  size_t slot = ring->next;
+  ring->timestamp_ns[slot] = timestamp_ns;
+  for (int c = 0; c < ring->columns; c++) {
+    ring->values[c * ring->capacity + slot] = row[c];
+  }
+  ring->next = slot + 1 == ring->capacity ? 0 : slot + 1;
+  if (ring->count < ring->capacity) {
+    ring->count++;
+  }
+}
+
+// Function that returns the slot of the i-th stored sample, 0 is the oldest.
+size_t historySlot(const HistoryRing *ring, size_t i) {
+  size_t oldest = ring->count < ring->capacity ? 0 : ring->next;
+  size_t slot = oldest + i;
+  return slot < ring->capacity ? slot : slot - ring->capacity;
+}
+
+// Function that returns a column of the i-th stored sample, 0 is the oldest.
+double historyValue(const HistoryRing *ring, int column, size_t i) {
+  return ring->values[column * ring->capacity + historySlot(ring, i)];
+}
+
+// Function to summarize a column over the samples taken at or after
+// since_ns, returns 0 when there are none.
+int historyWindow(const HistoryRing *ring, int column, int64_t since_ns,
+                  HistoryStats *stats) {
+  // Samples are stored in time order, so the window is a suffix of the ring
+  size_t first = ring->count;
+  while (first > 0 &&
+         ring->timestamp_ns[historySlot(ring, first - 1)] >= since_ns) {
+    first--;
+  }
+  stats->count = ring->count - first;
+  if (stats->count == 0) {
+    return 0;
+  }
+
+  // Walk the window as at most two contiguous runs of the column
+  const double *values = ring->values + column * ring->capacity;
+  size_t start = historySlot(ring, first);
+  size_t runs[2][2] = {{start, start + stats->count}, {0, 0}};
+  if (runs[0][1] > ring->capacity) {
+    runs[1][1] = runs[0][1] - ring->capacity;
+    runs[0][1] = ring->capacity;
+  }
+  double sum = 0;
+  stats->min = stats->max = values[start];
+  for (int r = 0; r < 2; r++) {
+    for (size_t s = runs[r][0]; s < runs[r][1]; s++) {
+      double value = values[s];
+      sum += value;
+      stats->min = value < stats->min ? value : stats->min;
+      stats->max = value > stats->max ? value : stats->max;
+    }
+  }
+  stats->avg = sum / stats->count;
+  return 1;
+}
+
+// Function to release a ring's memory.
+void freeHistory(HistoryRing *ring) {
+  free(ring->timestamp_ns);
+  free(ring->values);
+  ring->timestamp_ns = NULL;
+  ring->values = NULL;
+  ring->count = 0;
+}
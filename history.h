@@ -0,0 +1,39 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The last capacity samples of one source, stored column by column so a view
+// over one metric walks a single contiguous array. Everything is allocated
+// up front, once the ring is full the oldest sample is overwritten and the
+// memory used never grows again.
+typedef struct {
+  int columns;
+  size_t capacity;
+  size_t count;           // Samples stored, at most capacity
+  size_t next;            // Slot the next sample is written to
+  int64_t *timestamp_ns;  // capacity timestamps
+  double *values;         // columns arrays of capacity values, back to back
+} HistoryRing;
+
+// Summary of one column over a window of samples
+typedef struct {
+  size_t count;
+  double min;
+  double max;
+  double avg;
+} HistoryStats;
+
+// Function prototypes
+size_t historyCapacity(int columns, size_t budget);
+size_t historyBytes(const HistoryRing *ring);
+void initHistory(HistoryRing *ring, int columns, size_t capacity);
+void appendHistory(HistoryRing *ring, int64_t timestamp_ns,
+                   const double *row);
+size_t historySlot(const HistoryRing *ring, size_t i);
+double historyValue(const HistoryRing *ring, int column, size_t i);
+int historyWindow(const HistoryRing *ring, int column, int64_t since_ns,
+                  HistoryStats *stats);
+void freeHistory(HistoryRing *ring);
+#endif  // HISTORY_H
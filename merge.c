@@ -0,0 +1,252 @@
+#include "merge.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "query.h"
+#include "recording.h"
+#include "rollup.h"
+
+#define NS_PER_MS 1000000LL
+#define MERGE_SLOTS 4096     // Initial slots of a merged recording
+#define MERGE_SLOT_SIZE 64   // Slot size of a merged recording
+#define MERGE_PERCENTILE 95  // Percentile printed across recordings
+
+// One recording being merged and the value of the metric it last carried
+typedef struct {
+  Recording recording;
+  const RecordHeader *record;  // Next record in time order, NULL when done
+  MetricState state;
+  double value;
+  int64_t value_ns;  // When value was sampled, INT64_MIN before any
+  int64_t hold_ns;   // How long value stands for the recording
+} MergeInput;
+
+// Helper function that returns the record type carrying a metric.
+static uint32_t metricType(int metric) {
+  switch (metric) {
+    case ROLLUP_MEMORY_USED:
+    case ROLLUP_SWAP_USED:
+      return RECORD_MEMORY;
+    case ROLLUP_USERS:
+      return RECORD_USERS;
+    default:
+      return RECORD_CPU;
+  }
+}
+
+// Helper function to restore the heap order below position i, the heap
+// holds the indices of the inputs with records left, earliest record first.
+static void siftDown(int *heap, int size, const MergeInput *inputs, int i) {
+  for (;;) {
+    int least = i, left = 2 * i + 1, right = 2 * i + 2;
+    if (left < size && inputs[heap[left]].record->timestamp_ns <
+                           inputs[heap[least]].record->timestamp_ns) {
+      least = left;
+    }
+    if (right < size && inputs[heap[right]].record->timestamp_ns <
+                            inputs[heap[least]].record->timestamp_ns) {
+      least = right;
+    }
+    if (least == i) {
+      return;
+    }
+    int swap = heap[i];
+    heap[i] = heap[least];
+    heap[least] = swap;
+    i = least;
+  }
+}
+
+// Helper function to print the sum, max and percentile across inputs of the
+// values standing at grid point at_ns. Returns 0 when no input has one.
+static int printGridPoint(MergeInput *inputs, int count, double *scratch,
+                          int64_t at_ns) {
+  int hosts = 0;
+  double sum = 0, max = 0;
+  for (int i = 0; i < count; i++) {
+    const MergeInput *input = &inputs[i];
+    if (input->value_ns == INT64_MIN || input->value_ns > at_ns ||
+        at_ns - input->value_ns > input->hold_ns) {
+      continue;
+    }
+    sum += input->value;
+    max = hosts == 0 || input->value > max ? input->value : max;
+    scratch[hosts++] = input->value;
+  }
+  if (hosts == 0) {
+    return 0;
+  }
+  long k = (long)(MERGE_PERCENTILE / 100.0 * (hosts - 1));
+  selectNth(scratch, 0, hosts, k);
+  printf("%lld.%03lld %.2f %.2f %.2f %d\n", (long long)(at_ns / 1000000000),
+         (long long)(at_ns % 1000000000 / NS_PER_MS), sum, max, scratch[k],
+         hosts);
+  return 1;
+}
+
+// Helper function to describe the records of one more input in the header
+// of a merged recording, the longest run and the shortest intervals win.
+static void mergeLayout(RecordingHeader *layout,
+                        const RecordingHeader *input) {
+  layout->sample = input->sample > layout->sample ? input->sample
+                                                   : layout->sample;
+  layout->intervalMs = input->intervalMs < layout->intervalMs
+                           ? input->intervalMs
+                           : layout->intervalMs;
+  for (int type = 0; type < RECORDING_TYPES; type++) {
+    if (!(input->types >> type & 1)) {
+      continue;
+    }
+    int32_t *intervalMs = &layout->intervalsMs[type];
+    if (!(layout->types >> type & 1) || *intervalMs < 0 ||
+        (input->intervalsMs[type] >= 0 &&
+         input->intervalsMs[type] < *intervalMs)) {
+      *intervalMs = input->intervalsMs[type];
+    }
+  }
+  layout->types |= input->types;
+}
+
+// Function to merge recordings by timestamp. Every input keeps only its next
+// record, and a heap of them yields the records of all inputs in time order,
+// so memory grows with the number of inputs but not with their length.
+// Either the records are written to one merged recording, with the index of
+// the input they came from in their reserved field, which readers keep
+// their cpu counters apart by, or the metric is
+// resampled to a grid of stepMs, every input holding its last value until it
+// is two of its collector intervals old, and one line is printed per grid
+// point with the sum, max and p95 across the inputs holding a value.
+void runMerge(char *const *paths, int count, const MergeOptions *options) {
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  MergeInput *inputs = calloc(count, sizeof(MergeInput));
+  int *heap = malloc(count * sizeof(int));
+  double *scratch = malloc(count * sizeof(double));
+  if (inputs == NULL || heap == NULL || scratch == NULL) {
+    perror("malloc");
+    exit(EXIT_FAILURE);
+  }
+
+  int64_t step_ns = options->stepMs * NS_PER_MS;
+  uint32_t type = metricType(options->metric);
+  int size = 0;
+  for (int i = 0; i < count; i++) {
+    MergeInput *input = &inputs[i];
+    openRecording(&input->recording, paths[i]);
+    int32_t intervalMs = input->recording.header->intervalsMs[type];
+    input->hold_ns = intervalMs < 0 ? INT64_MAX : 2 * intervalMs * NS_PER_MS;
+    input->hold_ns = input->hold_ns < step_ns ? step_ns : input->hold_ns;
+    input->value_ns = INT64_MIN;
+    if ((input->record = readRecording(&input->recording)) != NULL) {
+      heap[size++] = i;
+    }
+  }
+  for (int i = size / 2 - 1; i >= 0; i--) {
+    siftDown(heap, size, inputs, i);
+  }
+
+  int series = options->outputPath == NULL;
+  Recording output = {.map = NULL};
+  if (!series) {
+    // Inputs may differ in cpus, so records span slots rather than fit one
+    RecordingHeader layout = *inputs[0].recording.header;
+    layout.slotSize = MERGE_SLOT_SIZE;
+    layout.codec = RECORDING_RAW;  // Only it keeps the reserved field
+    layout.sources = count;
+    for (int i = 1; i < count; i++) {
+      mergeLayout(&layout, inputs[i].recording.header);
+    }
+    startRecording(&output, options->outputPath, &layout, MERGE_SLOTS);
+    output.header->start_ns = INT64_MAX;
+    for (int i = 0; i < count; i++) {
+      int64_t start_ns = inputs[i].recording.header->start_ns;
+      if (start_ns < output.header->start_ns) {
+        output.header->start_ns = start_ns;
+      }
+    }
+  }
+
+  if (series) {
+    printf("# time %s: sum max p%d hosts\n", metricName(options->metric),
+           MERGE_PERCENTILE);
+  }
+  RecordHeader *copy = NULL;
+  size_t copyCapacity = 0;
+  uint64_t merged = 0, points = 0;
+  int64_t grid_ns = INT64_MIN, last_ns = INT64_MIN;
+  while (size > 0) {
+    MergeInput *input = &inputs[heap[0]];
+    const RecordHeader *record = input->record;
+    last_ns = record->timestamp_ns;
+    merged++;
+
+    if (!series) {
+      size_t bytes = sizeof(RecordHeader) + record->length;
+      if (copyCapacity < bytes) {
+        copyCapacity = bytes;
+        if ((copy = realloc(copy, copyCapacity)) == NULL) {
+          perror("realloc");
+          exit(EXIT_FAILURE);
+        }
+      }
+      memcpy(copy, record, bytes);
+      copy->reserved = heap[0];
+      appendRecording(&output, copy);
+    } else {
+      // Grid points before this record are final, a gap where no input has
+      // a value is skipped rather than walked
+      if (grid_ns == INT64_MIN) {
+        grid_ns = (last_ns + step_ns - 1) / step_ns * step_ns;
+      }
+      while (grid_ns < last_ns) {
+        if (!printGridPoint(inputs, count, scratch, grid_ns)) {
+          grid_ns = (last_ns + step_ns - 1) / step_ns * step_ns;
+          break;
+        }
+        points++;
+        grid_ns += step_ns;
+      }
+      double values[ROLLUP_METRICS];
+      if (recordMetrics(&input->state, record, values) &
+          1u << options->metric) {
+        input->value = values[options->metric];
+        input->value_ns = record->timestamp_ns;
+      }
+    }
+
+    if ((input->record = readRecording(&input->recording)) == NULL) {
+      heap[0] = heap[--size];
+    }
+    siftDown(heap, size, inputs, 0);
+  }
+  while (series && grid_ns != INT64_MIN && grid_ns <= last_ns &&
+         printGridPoint(inputs, count, scratch, grid_ns)) {
+    points++;
+    grid_ns += step_ns;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double ms = (end.tv_sec - start.tv_sec) * 1e3 +
+              (end.tv_nsec - start.tv_nsec) / 1e6;
+  if (!series) {
+    stopRecording(&output);
+    fprintf(stderr, "Merged %llu records of %d recordings in %.1f ms\n",
+            (unsigned long long)merged, count, ms);
+  } else {
+    fprintf(stderr,
+            "Merged %llu records of %d recordings into %llu points of %s "
+            "in %.1f ms\n",
+            (unsigned long long)merged, count, (unsigned long long)points,
+            metricName(options->metric), ms);
+  }
+  for (int i = 0; i < count; i++) {
+    closeRecording(&inputs[i].recording);
+  }
+  free(copy);
+  free(scratch);
+  free(heap);
+  free(inputs);
+}
@@ -0,0 +1,15 @@
+#ifndef MERGE_H
+#define MERGE_H
+
+#include <stdint.h>
+
+// What a merge of recordings produces
+typedef struct {
+  int64_t stepMs;          // Grid the aggregate series is resampled to
+  int metric;              // ROLLUP_ metric aggregated across recordings
+  const char *outputPath;  // Merged recording to write instead, or NULL
+} MergeOptions;
+
+// Function prototypes
+void runMerge(char *const *paths, int count, const MergeOptions *options);
+#endif  // MERGE_H
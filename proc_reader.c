@@ -0,0 +1,78 @@
+#include "proc_reader.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+// Function to open a /proc file if it isn't open yet, returns -1 on failure
+int openProcFile(ProcFile *file) {
+  if (file->fd != -1) {
+    return 0;
+  }
+  file->fd = open(file->path, O_RDONLY | O_CLOEXEC);
+  if (file->fd == -1) {
+    perror(file->path);
+    return -1;
+  }
+  return 0;
+}
+
+// Function to read a /proc file from the start into a caller owned buffer,
+// the content is null terminated and at most size - 1 bytes are read. Returns
+// the length read or -1 on failure.
+ssize_t readProcFile(ProcFile *file, char *buffer, size_t size) {
+  if (openProcFile(file) == -1) {
+    buffer[0] = '\0';
+    return -1;
+  }
+
+  // The /proc files read here are generated whole on every read, so one
+  // pread() returns everything that fits. A result that fills the buffer
+  // means the caller should retry with a larger one.
+  ssize_t nbytes;
+  do {
+    nbytes = pread(file->fd, buffer, size - 1, 0);
+  } while (nbytes == -1 && errno == EINTR);
+  if (nbytes == -1) {
+    perror(file->path);
+    buffer[0] = '\0';
+    return -1;
+  }
+  buffer[nbytes] = '\0';
+  return nbytes;
+}
+
+// Function to close a /proc file
+void closeProcFile(ProcFile *file) {
+  if (file->fd != -1) {
+    close(file->fd);
+    file->fd = -1;
+  }
+}
+
+// Function to parse one unsigned decimal number, skipping the spaces in front
+// of it and leaving *cursor after it. Unlike strtoull it ignores the locale
+// and has a single compare per digit.
+uint64_t parseUnsigned(const char **cursor) {
+  const char *p = *cursor;
+  while (*p == ' ' || *p == '\t') {
+    p++;
+  }
+  uint64_t value = 0;
+  unsigned digit;
+  while ((digit = (unsigned char)*p - '0') < 10) {
+    value = value * 10 + digit;
+    p++;
+  }
+  *cursor = p;
+  return value;
+}
+
+// Function that returns the start of the line after the cursor, or NULL at
+// the end of the text.
+const char *nextLine(const char *cursor) {
+  const char *newline = strchr(cursor, '\n');
+  return newline != NULL && newline[1] != '\0' ? newline + 1 : NULL;
+}
@@ -0,0 +1,24 @@
+#ifndef PROC_READER_H
+#define PROC_READER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// A /proc pseudo-file that is opened once and reread from offset 0 with
+// pread() on every sample. Opened before the collectors fork, the descriptor
+// is shared by every child and pread() never moves a shared offset.
+typedef struct {
+  const char *path;
+  int fd;
+} ProcFile;
+
+#define PROC_FILE(path) {(path), -1}
+
+// Function prototypes
+int openProcFile(ProcFile *file);
+ssize_t readProcFile(ProcFile *file, char *buffer, size_t size);
+void closeProcFile(ProcFile *file);
+uint64_t parseUnsigned(const char **cursor);
+const char *nextLine(const char *cursor);
+#endif  // PROC_READER_H
@@ -0,0 +1,485 @@
+#include "processes.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "proc_reader.h"
+#include "screen.h"
+
+// Bounded min-heap keeping the largest entries offered to it, the smallest
+// of them at the root so a new entry is compared once
+typedef struct {
+  ProcessEntry *entries;
+  int count;
+  int capacity;
+  int ranking;
+} TopHeap;
+
+// Share of a scan done by one thread, a run of the cache in pid order
+typedef struct {
+  ProcessScanner *scanner;
+  size_t begin;
+  size_t end;
+  double scale;  // Turns clock ticks into percent of one cpu, 0 at first
+  TopHeap heaps[PROCESS_RANKINGS];
+  uint32_t hits;  // Processes read with what the cache kept of them
+  pthread_t thread;
+  int started;
+} ScanPart;
+
+// Entry of a getdents64 listing
+typedef struct {
+  uint64_t d_ino;
+  int64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[];
+} ProcessDirent;
+
+// Helper function that returns what a ranking orders entries by.
+static double rankValue(const ProcessEntry *entry, int ranking) {
+  return ranking == PROCESS_BY_CPU ? entry->cpu : (double)entry->rss_kb;
+}
+
+// Helper function to offer an entry to a heap, it is kept while it is among
+// the largest offered. Processes with nothing to rank by are left out.
+static void offerTop(TopHeap *heap, const ProcessEntry *entry) {
+  ProcessEntry *entries = heap->entries;
+  double value = rankValue(entry, heap->ranking);
+  if (value <= 0) {
+    return;
+  }
+  int i;
+  if (heap->count < heap->capacity) {
+    for (i = heap->count++; i > 0; i = (i - 1) / 2) {
+      if (rankValue(&entries[(i - 1) / 2], heap->ranking) <= value) {
+        break;
+      }
+      entries[i] = entries[(i - 1) / 2];
+    }
+    entries[i] = *entry;
+    return;
+  }
+  if (heap->capacity == 0 || value <= rankValue(&entries[0], heap->ranking)) {
+    return;
+  }
+  for (i = 0; 2 * i + 1 < heap->count;) {
+    int child = 2 * i + 1;
+    if (child + 1 < heap->count &&
+        rankValue(&entries[child + 1], heap->ranking) <
+            rankValue(&entries[child], heap->ranking)) {
+      child++;
+    }
+    if (rankValue(&entries[child], heap->ranking) >= value) {
+      break;
+    }
+    entries[i] = entries[child];
+    i = child;
+  }
+  entries[i] = *entry;
+}
+
+// Helper functions ordering entries highest first for qsort().
+static int compareCpu(const void *a, const void *b) {
+  double x = ((const ProcessEntry *)a)->cpu;
+  double y = ((const ProcessEntry *)b)->cpu;
+  return (x < y) - (x > y);
+}
+
+static int compareMemory(const void *a, const void *b) {
+  uint64_t x = ((const ProcessEntry *)a)->rss_kb;
+  uint64_t y = ((const ProcessEntry *)b)->rss_kb;
+  return (x < y) - (x > y);
+}
+
+// Helper function that returns the cursor moved past count fields separated
+// by spaces.
+static const char *skipFields(const char *cursor, int count) {
+  while (count-- > 0) {
+    while (*cursor == ' ') {
+      cursor++;
+    }
+    while (*cursor != ' ' && *cursor != '\0') {
+      cursor++;
+    }
+  }
+  return cursor;
+}
+
+// Helper function to read the stat file of a process into buffer, through
+// the descriptor the cache kept, or by opening it. A newly opened file is
+// kept open while the budget allows. Returns the length read, 0 when the
+// process is gone.
+static ssize_t readStat(ProcessScanner *scanner, CachedProcess *process,
+                        char *buffer, size_t size) {
+  ssize_t nbytes = 0;
+  if (process->fd != -1) {
+    nbytes = pread(process->fd, buffer, size - 1, 0);
+    if (nbytes > 0) {
+      return nbytes;
+    }
+    // The process exited, a new one may have its pid
+    close(process->fd);
+    process->fd = -1;
+    __atomic_sub_fetch(&scanner->openFds, 1, __ATOMIC_RELAXED);
+  }
+
+  char path[32];
+  snprintf(path, sizeof(path), "%d/stat", process->pid);
+  int fd = openat(scanner->procFd, path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return 0;  // Exited since it was listed
+  }
+  nbytes = pread(fd, buffer, size - 1, 0);
+  if (nbytes > 0 && __atomic_add_fetch(&scanner->openFds, 1,
+                                       __ATOMIC_RELAXED) <= scanner->fdBudget) {
+    process->fd = fd;
+  } else {
+    if (nbytes > 0) {
+      __atomic_sub_fetch(&scanner->openFds, 1, __ATOMIC_RELAXED);
+    }
+    close(fd);
+  }
+  return nbytes > 0 ? nbytes : 0;
+}
+
+// Function run by every thread of a scan. Each process's counters are read
+// again, and a process the cache doesn't know yet, or whose pid was taken
+// by a new one, has its name taken too. Every process is then offered to
+// the thread's own heaps.
+static void *scanPart(void *context) {
+  ScanPart *part = context;
+  ProcessScanner *scanner = part->scanner;
+  for (size_t i = part->begin; i < part->end; i++) {
+    CachedProcess *process = &scanner->cache[i];
+    char buffer[1024];
+    ssize_t nbytes = readStat(scanner, process, buffer, sizeof(buffer));
+    if (nbytes == 0) {
+      process->starttime = UINT64_MAX;
+      continue;
+    }
+    buffer[nbytes] = '\0';
+
+    // The command name is between parentheses and may hold any character
+    const char *close = strrchr(buffer, ')');
+    if (close == NULL) {
+      continue;
+    }
+    ProcessEntry entry = {.pid = process->pid};
+    const char *cursor = skipFields(close + 1, 11);  // state to cmajflt
+    uint64_t used = parseUnsigned(&cursor);          // utime
+    used += parseUnsigned(&cursor);                  // stime
+    cursor = skipFields(cursor, 6);  // cutime to itrealvalue
+    uint64_t starttime = parseUnsigned(&cursor);
+    cursor = skipFields(cursor, 1);  // vsize
+    entry.rss_kb = parseUnsigned(&cursor) * scanner->pageKb;
+
+    // A process the last scan didn't see started after it
+    uint64_t delta = used;
+    if (starttime == process->starttime) {
+      delta = used >= process->ticks ? used - process->ticks : 0;
+      part->hits++;
+    } else {
+      const char *open = strchr(buffer, '(');
+      size_t length = open != NULL && open < close ? close - open - 1 : 0;
+      memset(process->comm, 0, sizeof(process->comm));
+      memcpy(process->comm, open + 1,
+             length < PROCESS_COMM - 1 ? length : PROCESS_COMM - 1);
+      process->starttime = starttime;
+    }
+    process->ticks = used;
+    memcpy(entry.comm, process->comm, sizeof(entry.comm));
+    entry.cpu = delta * part->scale;
+    for (int r = 0; r < PROCESS_RANKINGS; r++) {
+      offerTop(&part->heaps[r], &entry);
+    }
+  }
+  return NULL;
+}
+
+// Helper function to make room for capacity processes.
+static void growScanner(ProcessScanner *scanner, size_t capacity) {
+  scanner->pids = realloc(scanner->pids, capacity * sizeof(int32_t));
+  scanner->cache = realloc(scanner->cache, capacity * sizeof(CachedProcess));
+  scanner->next = realloc(scanner->next, capacity * sizeof(CachedProcess));
+  if (scanner->pids == NULL || scanner->cache == NULL ||
+      scanner->next == NULL) {
+    perror("realloc");
+    exit(EXIT_FAILURE);
+  }
+  scanner->capacity = capacity;
+}
+
+// Helper function to order pids for qsort().
+static int comparePids(const void *a, const void *b) {
+  int32_t x = *(const int32_t *)a, y = *(const int32_t *)b;
+  return (x > y) - (x < y);
+}
+
+// Helper function to list the pids in /proc, returns how many there are.
+// /proc lists processes in pid order, it is checked anyway.
+static size_t listProcesses(ProcessScanner *scanner) {
+  size_t count = 0;
+  int sorted = 1;
+  long nbytes;
+  lseek(scanner->procFd, 0, SEEK_SET);
+  while ((nbytes = syscall(SYS_getdents64, scanner->procFd, scanner->listing,
+                           PROCESS_LISTING)) > 0) {
+    for (long offset = 0; offset < nbytes;) {
+      const ProcessDirent *dirent =
+          (const ProcessDirent *)(scanner->listing + offset);
+      offset += dirent->d_reclen;
+      const char *name = dirent->d_name;
+      if (name[0] < '1' || name[0] > '9') {
+        continue;
+      }
+      if (count == scanner->capacity) {
+        growScanner(scanner, scanner->capacity * 2);
+      }
+      const char *cursor = name;
+      scanner->pids[count] = parseUnsigned(&cursor);
+      sorted &= count == 0 || scanner->pids[count] > scanner->pids[count - 1];
+      count++;
+    }
+  }
+  if (nbytes == -1) {
+    perror("/proc");
+  }
+  if (!sorted) {
+    qsort(scanner->pids, count, sizeof(int32_t), comparePids);
+  }
+  return count;
+}
+
+// Helper function to forget a process that exited.
+static void evictProcess(ProcessScanner *scanner, CachedProcess *process) {
+  if (process->fd != -1) {
+    close(process->fd);
+    scanner->openFds--;
+  }
+}
+
+// Helper function to bring the cache in line with the count pids listed,
+// walking both in pid order. Processes no longer listed are evicted, new
+// ones get an empty entry, and the others keep theirs.
+static void updateCache(ProcessScanner *scanner, size_t count,
+                        ProcessSample *sample) {
+  const CachedProcess *cache = scanner->cache;
+  size_t kept = 0;
+  for (size_t i = 0; i < count; i++) {
+    int32_t pid = scanner->pids[i];
+    while (kept < scanner->cached && cache[kept].pid < pid) {
+      evictProcess(scanner, &scanner->cache[kept++]);
+      sample->exited++;
+    }
+    if (kept < scanner->cached && cache[kept].pid == pid) {
+      scanner->next[i] = cache[kept++];
+    } else {
+      scanner->next[i] = (CachedProcess){.pid = pid, .fd = -1,
+                                         .starttime = UINT64_MAX};
+      sample->started++;
+    }
+  }
+  while (kept < scanner->cached) {
+    evictProcess(scanner, &scanner->cache[kept++]);
+    sample->exited++;
+  }
+  CachedProcess *swap = scanner->cache;
+  scanner->cache = scanner->next;
+  scanner->next = swap;
+  scanner->cached = count;
+}
+
+// Helper function to set how many stat files may be kept open for count
+// processes, raising the limit of open files only as far as they and some
+// room to grow need, within the hard limit. Done by the scans, so only the
+// collector child has its limit raised, and again when more processes run
+// than the budget covers.
+static void budgetFds(ProcessScanner *scanner, size_t count) {
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == -1) {
+    scanner->fdBudget = -1;
+    return;
+  }
+  rlim_t wanted = count + count / 4 + PROCESS_SPARE_FDS;
+  if (limit.rlim_cur < wanted && limit.rlim_cur < limit.rlim_max) {
+    limit.rlim_cur = wanted < limit.rlim_max ? wanted : limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+    getrlimit(RLIMIT_NOFILE, &limit);
+  }
+  rlim_t budget = limit.rlim_cur > PROCESS_SPARE_FDS
+                      ? limit.rlim_cur - PROCESS_SPARE_FDS
+                      : 0;
+  scanner->fdBudget = budget < INT32_MAX ? (int)budget : INT32_MAX;
+  if (scanner->fdBudget == 0) {
+    scanner->fdBudget = -1;  // Known, and none to spare
+  }
+}
+
+// Function to set up a scanner keeping top entries per ranking. /proc is
+// opened once, every scan lists it again and opens the stat files relative
+// to it.
+void initProcessScanner(ProcessScanner *scanner, int top) {
+  memset(scanner, 0, sizeof(*scanner));
+  scanner->procFd = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  scanner->listing = malloc(PROCESS_LISTING);
+  if (scanner->procFd == -1 || scanner->listing == NULL) {
+    perror("/proc");
+    exit(EXIT_FAILURE);
+  }
+  scanner->top = top;
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  scanner->maxThreads = cpus < 1                 ? 1
+                        : cpus < PROCESS_THREADS ? cpus
+                                                 : PROCESS_THREADS;
+  scanner->heaps = malloc((size_t)(PROCESS_THREADS + 1) * PROCESS_RANKINGS *
+                          (top > 0 ? top : 1) * sizeof(ProcessEntry));
+  if (scanner->heaps == NULL) {
+    perror("malloc");
+    exit(EXIT_FAILURE);
+  }
+  scanner->clockTicks = sysconf(_SC_CLK_TCK);
+  scanner->pageKb = sysconf(_SC_PAGESIZE) / 1024;
+  growScanner(scanner, 4096);
+}
+
+// Function to scan every process and return the top ones by cpu and by
+// memory. The cache is updated from the listing first, then split in
+// contiguous runs, one per thread, and every thread keeps bounded heaps of
+// its own, so the threads only write to their own run of the cache. Their
+// heaps are merged at the end. Cpu usage is over the time since the last
+// scan, the first scan only sets it up. The sample is allocated, the
+// caller frees it.
+ProcessSample *scanProcesses(ProcessScanner *scanner, size_t *size) {
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  *size = sizeof(ProcessSample) +
+          (size_t)PROCESS_RANKINGS * scanner->top * sizeof(ProcessEntry);
+  ProcessSample *sample = calloc(1, *size);
+  if (sample == NULL) {
+    perror("calloc");
+    exit(EXIT_FAILURE);
+  }
+  size_t count = listProcesses(scanner);
+  if (scanner->fdBudget == 0 ||
+      (scanner->fdBudget > 0 && count > (size_t)scanner->fdBudget)) {
+    budgetFds(scanner, count);
+  }
+  updateCache(scanner, count, sample);
+
+  double elapsed = start.tv_sec - scanner->prevTime.tv_sec +
+                   (start.tv_nsec - scanner->prevTime.tv_nsec) / 1e9;
+  double scale = scanner->prevTime.tv_sec != 0 && elapsed > 0
+                     ? 100.0 / (scanner->clockTicks * elapsed)
+                     : 0;
+  int threads = (count + PROCESS_PER_THREAD - 1) / PROCESS_PER_THREAD;
+  threads = threads < 1                     ? 1
+            : threads > scanner->maxThreads ? scanner->maxThreads
+                                            : threads;
+
+  ScanPart parts[PROCESS_THREADS];
+  for (int t = 0; t < threads; t++) {
+    ScanPart *part = &parts[t];
+    part->scanner = scanner;
+    part->begin = count * t / threads;
+    part->end = count * (t + 1) / threads;
+    part->scale = scale;
+    part->hits = 0;
+    for (int r = 0; r < PROCESS_RANKINGS; r++) {
+      part->heaps[r] = (TopHeap){
+          scanner->heaps + (size_t)(t * PROCESS_RANKINGS + r) * scanner->top,
+          0, scanner->top, r};
+    }
+    // The calling thread takes the first part, and any part a thread
+    // couldn't be started for
+    part->started = t > 0 && part->begin < part->end &&
+                    pthread_create(&part->thread, NULL, scanPart, part) == 0;
+  }
+  for (int t = 0; t < threads; t++) {
+    if (!parts[t].started && parts[t].begin < parts[t].end) {
+      scanPart(&parts[t]);
+    }
+  }
+  for (int t = 0; t < threads; t++) {
+    if (parts[t].started) {
+      pthread_join(parts[t].thread, NULL);
+    }
+  }
+
+  for (int t = 0; t < threads; t++) {
+    sample->cached += parts[t].hits;
+  }
+  for (int r = 0; r < PROCESS_RANKINGS; r++) {
+    size_t slot = (size_t)PROCESS_THREADS * PROCESS_RANKINGS + r;
+    TopHeap merged = {scanner->heaps + slot * scanner->top, 0, scanner->top,
+                      r};
+    for (int t = 0; t < threads; t++) {
+      for (int i = 0; i < parts[t].heaps[r].count; i++) {
+        offerTop(&merged, &parts[t].heaps[r].entries[i]);
+      }
+    }
+    qsort(merged.entries, merged.count, sizeof(ProcessEntry),
+          r == PROCESS_BY_CPU ? compareCpu : compareMemory);
+    memcpy(sample->top + (size_t)r * scanner->top, merged.entries,
+           merged.count * sizeof(ProcessEntry));
+  }
+
+  scanner->prevTime = start;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  sample->processes = count;
+  sample->threads = threads;
+  sample->count = scanner->top;
+  sample->scan_us = (end.tv_sec - start.tv_sec) * 1000000 +
+                    (end.tv_nsec - start.tv_nsec) / 1000;
+  return sample;
+}
+
+// Function to print the top processes by cpu and by memory side by side,
+// every row is cleared first as lists get shorter when processes exit.
+void printProcesses(const ProcessSample *sample) {
+  clearToEnd();
+  screenPrintf("%u processes, %.1f%% cached, %u started, %u exited, "
+               "%u threads, %.2f ms\n",
+               sample->processes,
+               sample->processes ? 100.0 * sample->cached / sample->processes
+                                 : 0,
+               sample->started, sample->exited, sample->threads,
+               sample->scan_us / 1000.0);
+  clearToEnd();
+  screenPrintf("%7s %-15s %6s   %7s %-15s %9s\n", "PID", "COMMAND", "CPU",
+               "PID", "COMMAND", "MEMORY");
+  const ProcessEntry *cpu = sample->top;
+  const ProcessEntry *memory = sample->top + sample->count;
+  for (uint32_t i = 0; i < sample->count; i++) {
+    clearToEnd();
+    if (cpu[i].pid != 0) {
+      screenPrintf("%7d %-15s %5.1f%%", cpu[i].pid, cpu[i].comm, cpu[i].cpu);
+    } else {
+      screenPrintf("%30s", "");
+    }
+    if (memory[i].pid != 0) {
+      screenPrintf("   %7d %-15s %6.1f MB", memory[i].pid, memory[i].comm,
+                   memory[i].rss_kb / 1024.0);
+    }
+    screenPrintf("\n");
+  }
+}
+
+// Function to release what a scanner holds.
+void freeProcessScanner(ProcessScanner *scanner) {
+  for (size_t i = 0; i < scanner->cached; i++) {
+    evictProcess(scanner, &scanner->cache[i]);
+  }
+  close(scanner->procFd);
+  free(scanner->listing);
+  free(scanner->pids);
+  free(scanner->cache);
+  free(scanner->next);
+  free(scanner->heaps);
+}
@@ -0,0 +1,88 @@
+#ifndef PROCESSES_H
+#define PROCESSES_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#define PROCESS_TOP 5           // Entries per ranking when --top has no count
+#define PROCESS_THREADS 8       // Most threads a scan is split across
+#define PROCESS_PER_THREAD 512  // Processes worth starting one more thread
+#define PROCESS_COMM 16         // Command names are cut to 15 characters
+#define PROCESS_LISTING 65536   // Bytes of /proc listed per getdents64 call
+#define PROCESS_SPARE_FDS 256   // Descriptors not used to keep stat files
+
+// What processes are ranked by, a sample holds a top list for each
+enum {
+  PROCESS_BY_CPU,
+  PROCESS_BY_MEMORY,
+  PROCESS_RANKINGS
+};
+
+// One process of a top list
+typedef struct {
+  int32_t pid;
+  uint32_t reserved;
+  double cpu;  // Percent of one cpu over the last interval
+  uint64_t rss_kb;
+  char comm[PROCESS_COMM];
+} ProcessEntry;
+
+// Top processes at one snapshot in time, PROCESS_RANKINGS lists of count
+// entries follow, cpu first, each highest first. A list is shorter when
+// fewer processes run, its unused entries have a pid of 0.
+typedef struct {
+  uint32_t processes;  // Processes scanned
+  uint32_t cached;     // Found in the cache from the last scan
+  uint32_t started;    // Listed for the first time
+  uint32_t exited;     // No longer listed
+  uint32_t threads;    // Threads the scan was split across
+  uint32_t count;      // Entries per ranking
+  uint32_t scan_us;    // Time the scan took
+  uint32_t reserved;
+  ProcessEntry top[];
+} ProcessSample;
+
+// A process as the last scan saw it. A pid is only the same process while
+// its start time stays the same, what never changes for a process is kept
+// and only its counters are read again, through its stat file kept open.
+typedef struct {
+  int32_t pid;
+  int fd;              // Open stat file, -1 when not kept open
+  uint64_t starttime;  // Clock ticks after boot, UINT64_MAX until read
+  uint64_t ticks;      // User and system time, in clock ticks
+  char comm[PROCESS_COMM];
+} CachedProcess;
+
+// Scans the stat file of every process, split across threads, through a
+// cache of the processes of the last scan. Listing /proc with getdents64
+// and comparing it with the cache tells which processes started and
+// exited, only those are opened and parsed in full. Lives in the collector
+// child, which has to be persistent to keep it between samples. What is
+// left is one pread of stat per process, about 5.5 us of kernel time each,
+// so 50k processes cost about 275 ms of cpu per scan across the threads.
+typedef struct {
+  int procFd;
+  int top;         // Entries per ranking
+  int maxThreads;  // Online cpus, up to PROCESS_THREADS
+  int32_t *pids;   // Listed by the current scan
+  CachedProcess *cache;  // In pid order
+  CachedProcess *next;   // The cache being rebuilt
+  size_t cached;
+  size_t capacity;  // Of pids, cache and next
+  int openFds;      // Stat files kept open
+  int fdBudget;     // and how many may be, 0 until the first scan
+  char *listing;    // PROCESS_LISTING bytes
+  ProcessEntry *heaps;  // Room for top entries per ranking per thread,
+                        // and for the merged lists
+  struct timespec prevTime;
+  long clockTicks;  // Per second
+  long pageKb;
+} ProcessScanner;
+
+// Function prototypes
+void initProcessScanner(ProcessScanner *scanner, int top);
+ProcessSample *scanProcesses(ProcessScanner *scanner, size_t *size);
+void printProcesses(const ProcessSample *sample);
+void freeProcessScanner(ProcessScanner *scanner);
+#endif  // PROCESSES_H
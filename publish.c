@@ -0,0 +1,122 @@
+#include "publish.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+_Static_assert(MEM_FIELDS == SNAPSHOT_MEM_FIELDS,
+               "a new memory field needs a new snapshot version");
+
+// Helper function that returns 1 when the monitor that published a name
+// is gone without removing it, as when it was interrupted or killed.
+static int ownerGone(const char *name) {
+  int fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+  if (fd == -1) {
+    return errno == ENOENT;  // Removed meanwhile
+  }
+  SharedSnapshot *shared =
+      mmap(NULL, sizeof(SharedSnapshot), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (shared == MAP_FAILED) {
+    return 0;
+  }
+  pid_t owner = shared->owner;
+  munmap(shared, sizeof(SharedSnapshot));
+  return owner > 0 && kill(owner, 0) == -1 && errno == ESRCH;
+}
+
+// Function to create the shared memory object readers open by name, with
+// no sample in it yet. A name another running monitor publishes is
+// refused, two monitors publishing the same object would corrupt each
+// other's sequence. One left behind by a monitor that is gone is taken
+// over.
+SharedSnapshot *createSnapshot(const char *name) {
+  int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+  if (fd == -1 && errno == EEXIST && ownerGone(name)) {
+    shm_unlink(name);
+    fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+  }
+  if (fd == -1 && errno == EEXIST) {
+    fprintf(stderr,
+            "%s: already published by another run, remove /dev/shm%s if "
+            "none is running\n",
+            name, name);
+    exit(EXIT_FAILURE);
+  }
+  if (fd == -1 || ftruncate(fd, sizeof(SharedSnapshot)) == -1) {
+    perror(name);
+    exit(EXIT_FAILURE);
+  }
+  SharedSnapshot *shared = mmap(NULL, sizeof(SharedSnapshot),
+                                PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (shared == MAP_FAILED) {
+    perror(name);
+    exit(EXIT_FAILURE);
+  }
+  memset(shared, 0, sizeof(*shared));
+  shared->version = SNAPSHOT_VERSION;
+  shared->size = sizeof(Snapshot);
+  shared->owner = getpid();
+  memcpy(shared->magic, SNAPSHOT_MAGIC, sizeof(shared->magic));
+  return shared;
+}
+
+// Function to take the values a record carries into the next snapshot, cpu
+// records through the usage already computed from them. Usage measured
+// since boot isn't published.
+void updateSnapshot(Snapshot *snapshot, const RecordHeader *record,
+                    const CpuUsage *usage) {
+  const void *payload = record + 1;
+  switch (record->type) {
+    case RECORD_CPU:
+      snapshot->num_cpus = usage->rows - 1;
+      if (usage->sinceBoot) {
+        snapshot->valid &= ~SNAPSHOT_CPU;  // No usage over an interval yet
+        break;
+      }
+      snapshot->cpu_busy = usage->busy[0];
+      snapshot->cpu_iowait = usage->iowait[0];
+      snapshot->cpu_steal = usage->steal[0];
+      snapshot->cpu_guest = usage->guest[0];
+      snapshot->valid |= SNAPSHOT_CPU;
+      break;
+    case RECORD_MEMORY:
+      memcpy(snapshot->memory_kb, ((const MemorySample *)payload)->kb,
+             sizeof(snapshot->memory_kb));
+      snapshot->valid |= SNAPSHOT_MEMORY;
+      break;
+    case RECORD_USERS:
+      snapshot->users = ((const UsersSample *)payload)->count;
+      snapshot->valid |= SNAPSHOT_USERS;
+      break;
+    default:
+      return;
+  }
+  snapshot->tick = record->tick;
+  if (record->timestamp_ns > snapshot->timestamp_ns) {
+    snapshot->timestamp_ns = record->timestamp_ns;
+  }
+}
+
+// Function to publish a snapshot. Readers never wait for the writer, one
+// that copies while the sequence is odd or changes retries.
+void publishSnapshot(SharedSnapshot *shared, const Snapshot *snapshot) {
+  uint64_t sequence = shared->sequence;
+  __atomic_store_n(&shared->sequence, sequence + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  memcpy(&shared->snapshot, snapshot, sizeof(*snapshot));
+  __atomic_store_n(&shared->sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+// Function to unmap and remove the shared memory object, readers that have
+// it mapped keep the last snapshot.
+void removeSnapshot(SharedSnapshot *shared, const char *name) {
+  munmap(shared, sizeof(*shared));
+  shm_unlink(name);
+}
@@ -0,0 +1,14 @@
+#ifndef PUBLISH_H
+#define PUBLISH_H
+
+#include "collectors.h"
+#include "snapshot.h"
+#include "stats_functions.h"
+
+// Function prototypes
+SharedSnapshot *createSnapshot(const char *name);
+void updateSnapshot(Snapshot *snapshot, const RecordHeader *record,
+                    const CpuUsage *usage);
+void publishSnapshot(SharedSnapshot *shared, const Snapshot *snapshot);
+void removeSnapshot(SharedSnapshot *shared, const char *name);
+#endif  // PUBLISH_H
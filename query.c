@@ -0,0 +1,430 @@
+#include "query.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "recording.h"
+#include "rollup.h"
+#include "stats_functions.h"
+
+#define NS_PER_MS 1000000LL
+#define QUERY_SLACK_NS 1000000000LL  // How out of order records can be
+
+// Names and units of the metrics a query aggregates, indexed like rollups
+static const char *const metricNames[ROLLUP_METRICS] = {
+    [ROLLUP_CPU_BUSY] = "cpu",       [ROLLUP_CPU_IOWAIT] = "iowait",
+    [ROLLUP_CPU_STEAL] = "steal",    [ROLLUP_MEMORY_USED] = "memory",
+    [ROLLUP_SWAP_USED] = "swap",     [ROLLUP_USERS] = "users"};
+static const char *const metricUnits[ROLLUP_METRICS] = {
+    [ROLLUP_CPU_BUSY] = "%",         [ROLLUP_CPU_IOWAIT] = "%",
+    [ROLLUP_CPU_STEAL] = "%",        [ROLLUP_MEMORY_USED] = "GB",
+    [ROLLUP_SWAP_USED] = "GB",       [ROLLUP_USERS] = ""};
+
+// What the rollups keep in kB, a query reports in GB
+static const double rollupScales[ROLLUP_METRICS] = {
+    [ROLLUP_CPU_BUSY] = 1,           [ROLLUP_CPU_IOWAIT] = 1,
+    [ROLLUP_CPU_STEAL] = 1,          [ROLLUP_MEMORY_USED] = 1024 * 1024,
+    [ROLLUP_SWAP_USED] = 1024 * 1024, [ROLLUP_USERS] = 1};
+
+// Percentiles printed for every metric, in increasing order
+static const double percentiles[] = {50, 90, 95, 99};
+#define PERCENTILES (sizeof(percentiles) / sizeof(percentiles[0]))
+
+// Values of one metric in time order
+typedef struct {
+  double *values;
+  size_t count;
+  size_t capacity;
+} Column;
+
+// Min, max and average of a column
+typedef struct {
+  double min;
+  double max;
+  double avg;
+} Summary;
+
+// Helper function to add a value at the end of a column.
+static void appendColumn(Column *column, double value) {
+  if (column->count == column->capacity) {
+    column->capacity = column->capacity ? column->capacity * 2 : 4096;
+    column->values =
+        realloc(column->values, column->capacity * sizeof(double));
+    if (column->values == NULL) {
+      perror("realloc");
+      exit(EXIT_FAILURE);
+    }
+  }
+  column->values[column->count++] = value;
+}
+
+// Function that returns the metric named by the first length characters of
+// name, exits when there is none.
+int findMetric(const char *name, size_t length) {
+  for (int m = 0; m < ROLLUP_METRICS; m++) {
+    if (strlen(metricNames[m]) == length &&
+        strncmp(name, metricNames[m], length) == 0) {
+      return m;
+    }
+  }
+  fprintf(stderr, "Unknown metric %.*s\n", (int)length, name);
+  exit(EXIT_FAILURE);
+}
+
+// Function that returns the name of a metric.
+const char *metricName(int metric) { return metricNames[metric]; }
+
+// Helper function to mark the metrics named in a comma separated list, or
+// all of them when there is no list.
+static void selectMetrics(const char *list, int *selected) {
+  for (int m = 0; m < ROLLUP_METRICS; m++) {
+    selected[m] = list == NULL;
+  }
+  while (list != NULL && *list != '\0') {
+    size_t length = strcspn(list, ",");
+    selected[findMetric(list, length)] = 1;
+    list += length + (list[length] == ',');
+  }
+}
+
+// Function to turn a record into the values of the metrics it carries,
+// returns a mask of the metrics set. Cpu usage is over the interval since
+// the previous cpu record of the same source, computed like
+// updateCpuUsage() does, so the first cpu record of a source only sets up
+// the state.
+unsigned recordMetrics(MetricState *state, const RecordHeader *record,
+                       double *values) {
+  const void *payload = record + 1;
+  if (record->type == RECORD_CPU) {
+    if (record->reserved < 0 || record->reserved >= METRIC_SOURCES) {
+      return 0;
+    }
+    uint64_t *prev = state->prev[record->reserved];
+    const uint64_t *curr = ((const CpuSample *)payload)->counters;
+    uint64_t d[CPU_FIELDS];
+    for (int f = 0; f < CPU_FIELDS; f++) {
+      d[f] = curr[f] >= prev[f] ? curr[f] - prev[f] : 0;
+      prev[f] = curr[f];
+    }
+    uint64_t total = d[CPU_USER] + d[CPU_NICE] + d[CPU_SYSTEM] + d[CPU_IDLE] +
+                     d[CPU_IOWAIT] + d[CPU_IRQ] + d[CPU_SOFTIRQ] + d[CPU_STEAL];
+    int first = !state->havePrev[record->reserved];
+    state->havePrev[record->reserved] = 1;
+    if (first || total == 0) {
+      return 0;
+    }
+    double scale = 100.0 / (double)total;
+    values[ROLLUP_CPU_BUSY] =
+        (double)(total - d[CPU_IDLE] - d[CPU_IOWAIT] - d[CPU_STEAL]) * scale;
+    values[ROLLUP_CPU_IOWAIT] = d[CPU_IOWAIT] * scale;
+    values[ROLLUP_CPU_STEAL] = d[CPU_STEAL] * scale;
+    return 1u << ROLLUP_CPU_BUSY | 1u << ROLLUP_CPU_IOWAIT |
+           1u << ROLLUP_CPU_STEAL;
+  }
+  if (record->type == RECORD_MEMORY) {
+    const uint64_t *kb = ((const MemorySample *)payload)->kb;
+    values[ROLLUP_MEMORY_USED] =
+        ((double)kb[MEM_TOTAL] - kb[MEM_AVAILABLE]) / (1024 * 1024);
+    values[ROLLUP_SWAP_USED] =
+        ((double)kb[MEM_SWAP_TOTAL] - kb[MEM_SWAP_FREE]) / (1024 * 1024);
+    return 1u << ROLLUP_MEMORY_USED | 1u << ROLLUP_SWAP_USED;
+  }
+  if (record->type == RECORD_USERS) {
+    values[ROLLUP_USERS] = ((const UsersSample *)payload)->count;
+    return 1u << ROLLUP_USERS;
+  }
+  return 0;
+}
+
+// Function to compute the min, max and average of count values. Four
+// independent lanes keep the loop free of dependencies between iterations so
+// the compiler can vectorize it.
+static void summarize(const double *restrict values, size_t count,
+                      Summary *summary) {
+  double min[4], max[4], sum[4] = {0, 0, 0, 0};
+  for (int lane = 0; lane < 4; lane++) {
+    min[lane] = max[lane] = values[0];
+  }
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    for (int lane = 0; lane < 4; lane++) {
+      double value = values[i + lane];
+      min[lane] = value < min[lane] ? value : min[lane];
+      max[lane] = value > max[lane] ? value : max[lane];
+      sum[lane] += value;
+    }
+  }
+  for (; i < count; i++) {
+    min[0] = values[i] < min[0] ? values[i] : min[0];
+    max[0] = values[i] > max[0] ? values[i] : max[0];
+    sum[0] += values[i];
+  }
+  summary->min = min[0];
+  summary->max = max[0];
+  for (int lane = 1; lane < 4; lane++) {
+    summary->min = min[lane] < summary->min ? min[lane] : summary->min;
+    summary->max = max[lane] > summary->max ? max[lane] : summary->max;
+  }
+  summary->avg = (sum[0] + sum[1] + sum[2] + sum[3]) / count;
+}
+
+// Function to partially sort values[low, high) so values[k] is the value a
+// full sort would put there, with nothing smaller after it. Expected linear
+// time, unlike sorting.
+void selectNth(double *values, long low, long high, long k) {
+  while (high - low > 1) {
+    double a = values[low], b = values[low + (high - low) / 2],
+           c = values[high - 1];
+    double pivot = a < b ? (b < c ? b : (a < c ? c : a))
+                         : (a < c ? a : (b < c ? c : b));
+    long i = low, j = high - 1;
+    while (i <= j) {
+      while (values[i] < pivot) {
+        i++;
+      }
+      while (values[j] > pivot) {
+        j--;
+      }
+      if (i <= j) {
+        double swap = values[i];
+        values[i++] = values[j];
+        values[j--] = swap;
+      }
+    }
+    // Now [low, j] holds no larger values than the pivot, [i, high) no
+    // smaller ones, and anything between equals the pivot.
+    if (k <= j) {
+      high = j + 1;
+    } else if (k >= i) {
+      low = i;
+    } else {
+      return;
+    }
+  }
+}
+
+// Function to print the summary and percentiles of a column, the column is
+// reordered.
+static void printColumn(int metric, Column *column) {
+  printf("%-7s %-2s %9zu samples", metricNames[metric], metricUnits[metric],
+         column->count);
+  if (column->count == 0) {
+    printf("\n");
+    return;
+  }
+  Summary summary;
+  summarize(column->values, column->count, &summary);
+  printf("  min %.2f  avg %.2f  max %.2f", summary.min, summary.avg,
+         summary.max);
+
+  // Each selection leaves larger values after it, so the next percentile
+  // only searches what is left
+  long low = 0;
+  for (size_t p = 0; p < PERCENTILES; p++) {
+    long k = (long)(percentiles[p] / 100 * (column->count - 1));
+    selectNth(column->values, low, column->count, k);
+    printf("  p%.0f %.2f", percentiles[p], column->values[k]);
+    low = k;
+  }
+  printf("\n");
+}
+
+// Helper function to gather the metrics of the records in [from_ns, to_ns]
+// one column per metric, returns the number of records read. The index
+// brings reading to the block holding from_ns.
+static size_t scanRecords(Recording *recording, int64_t from_ns,
+                          int64_t to_ns, Column *columns) {
+  seekRecording(recording, from_ns);
+  MetricState state;
+  memset(&state, 0, sizeof(state));
+  size_t scanned = 0;
+  const RecordHeader *record;
+  while ((record = readRecording(recording)) != NULL &&
+         record->timestamp_ns <= to_ns + QUERY_SLACK_NS) {
+    scanned++;
+    double values[ROLLUP_METRICS];
+    unsigned found = recordMetrics(&state, record, values);
+    if (record->timestamp_ns < from_ns || record->timestamp_ns > to_ns) {
+      continue;
+    }
+    for (int m = 0; m < ROLLUP_METRICS; m++) {
+      if (found & 1u << m) {
+        appendColumn(&columns[m], values[m]);
+      }
+    }
+  }
+  return scanned;
+}
+
+// Helper function to fold the values of every column into its metric's
+// cell and empty the columns.
+static void foldColumns(Column *columns, RollupCell *cells) {
+  for (int m = 0; m < ROLLUP_METRICS; m++) {
+    for (size_t i = 0; i < columns[m].count; i++) {
+      double value = columns[m].values[i];
+      RollupCell *cell = &cells[m];
+      cell->min = cell->count == 0 || value < cell->min ? value : cell->min;
+      cell->max = cell->count == 0 || value > cell->max ? value : cell->max;
+      cell->sum += value;
+      cell->count++;
+    }
+    columns[m].count = 0;
+  }
+}
+
+// Helper function that returns the coarsest tier with whole buckets in
+// [from_ns, to_ns], setting [low_ns, high_ns) to the span they cover, or -1
+// when no tier retains any. The span ends with the newest bucket, which an
+// open ended range takes whole as nothing is later.
+static int coveringTier(const Rollups *rollups, int64_t from_ns,
+                        int64_t to_ns, int64_t *low_ns, int64_t *high_ns) {
+  for (int t = ROLLUP_TIERS - 1; t >= 0; t--) {
+    int64_t width = rollups->header->tiers[t].width_ns;
+    uint64_t count = rollupCount(rollups, t);
+    if (count == 0) {
+      continue;
+    }
+    int64_t first = rollupBucket(rollups, t, 0)->start_ns;
+    int64_t last = rollupBucket(rollups, t, count - 1)->start_ns + width;
+    int64_t low = (from_ns + width - 1) / width * width;
+    low = low > first ? low : first;
+    int64_t high = to_ns == INT64_MAX - QUERY_SLACK_NS
+                       ? last
+                       : (to_ns + 1) / width * width;
+    high = high < last ? high : last;
+    for (uint64_t i = 0; low < high && i < count; i++) {
+      int64_t start = rollupBucket(rollups, t, i)->start_ns;
+      if (start >= low && start < high) {
+        *low_ns = low;
+        *high_ns = high;
+        return t;
+      }
+    }
+  }
+  return -1;
+}
+
+// Function to print the min, max and average of the selected metrics over a
+// time range, the whole buckets of the coarsest rollup tier covering it
+// stand for their samples. Only the records at the ends of the range that
+// fall in no whole bucket are read, all of them when there are no rollups.
+static size_t summarizeRange(Recording *recording, const char *path,
+                             int64_t from_ns, int64_t to_ns,
+                             const int *selected) {
+  RollupCell cells[ROLLUP_METRICS];
+  memset(cells, 0, sizeof(cells));
+  Column columns[ROLLUP_METRICS];
+  memset(columns, 0, sizeof(columns));
+  size_t scanned = 0;
+
+  char rollupPath[PATH_MAX];
+  snprintf(rollupPath, sizeof(rollupPath), "%s.rollup", path);
+  Rollups rollups = {.map = NULL};
+  int64_t low_ns, high_ns;
+  int tier = -1;
+  if (access(rollupPath, R_OK) == 0) {
+    openRollups(&rollups, rollupPath);
+    tier = coveringTier(&rollups, from_ns, to_ns, &low_ns, &high_ns);
+  }
+  if (tier == -1) {
+    scanned += scanRecords(recording, from_ns, to_ns, columns);
+    foldColumns(columns, cells);
+  } else {
+    for (uint64_t i = 0; i < rollupCount(&rollups, tier); i++) {
+      const RollupBucket *bucket = rollupBucket(&rollups, tier, i);
+      if (bucket->start_ns < low_ns || bucket->start_ns >= high_ns) {
+        continue;
+      }
+      for (int m = 0; m < ROLLUP_METRICS; m++) {
+        const RollupCell *add = &bucket->cells[m];
+        RollupCell *cell = &cells[m];
+        if (add->count == 0) {
+          continue;
+        }
+        double min = add->min / rollupScales[m];
+        double max = add->max / rollupScales[m];
+        cell->min = cell->count == 0 || min < cell->min ? min : cell->min;
+        cell->max = cell->count == 0 || max > cell->max ? max : cell->max;
+        cell->sum += add->sum / rollupScales[m];
+        cell->count += add->count;
+      }
+    }
+    if (from_ns < low_ns) {
+      scanned += scanRecords(recording, from_ns, low_ns - 1, columns);
+      foldColumns(columns, cells);
+    }
+    // Nothing is later than the newest bucket of an open ended range
+    if (high_ns <= to_ns && to_ns != INT64_MAX - QUERY_SLACK_NS) {
+      scanned += scanRecords(recording, high_ns, to_ns, columns);
+      foldColumns(columns, cells);
+    }
+  }
+
+  for (int m = 0; m < ROLLUP_METRICS; m++) {
+    if (!selected[m]) {
+      continue;
+    }
+    const RollupCell *cell = &cells[m];
+    printf("%-7s %-2s %9lu samples", metricNames[m], metricUnits[m],
+           (unsigned long)cell->count);
+    if (cell->count > 0) {
+      printf("  min %.2f  avg %.2f  max %.2f", cell->min,
+             cell->sum / cell->count, cell->max);
+    }
+    printf("\n");
+  }
+  if (tier != -1) {
+    long seconds = rollups.header->tiers[tier].width_ns / 1000000000LL;
+    printf("Rollups of %ld s from %.0f s to %.0f s\n", seconds,
+           (low_ns - recording->header->start_ns) / 1e9,
+           (high_ns - recording->header->start_ns) / 1e9);
+  }
+  for (int m = 0; m < ROLLUP_METRICS; m++) {
+    free(columns[m].values);
+  }
+  closeRollups(&rollups);
+  return scanned;
+}
+
+// Function to aggregate the selected metrics of a recording over a time
+// range. The samples in range are gathered one column per metric, and every
+// column is then summarized in a single tight loop. A summary of min, max
+// and average is answered from the rollups instead where they cover the
+// range.
+void runQuery(const char *path, const QueryRange *range) {
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  int selected[ROLLUP_METRICS];
+  selectMetrics(range->metrics, selected);
+
+  Recording recording;
+  openRecording(&recording, path);
+  int64_t from_ns = recording.header->start_ns + range->fromMs * NS_PER_MS;
+  int64_t to_ns = range->toMs < 0
+                      ? INT64_MAX - QUERY_SLACK_NS
+                      : recording.header->start_ns + range->toMs * NS_PER_MS;
+
+  size_t scanned;
+  if (range->summary) {
+    scanned = summarizeRange(&recording, path, from_ns, to_ns, selected);
+  } else {
+    Column columns[ROLLUP_METRICS];
+    memset(columns, 0, sizeof(columns));
+    scanned = scanRecords(&recording, from_ns, to_ns, columns);
+    for (int m = 0; m < ROLLUP_METRICS; m++) {
+      if (selected[m]) {
+        printColumn(m, &columns[m]);
+      }
+      free(columns[m].values);
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  printf("Scanned %zu records in %.1f ms\n", scanned,
+         (end.tv_sec - start.tv_sec) * 1e3 +
+             (end.tv_nsec - start.tv_nsec) / 1e6);
+  closeRecording(&recording);
+}
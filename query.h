@@ -0,0 +1,36 @@
+#ifndef QUERY_H
+#define QUERY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "collectors.h"
+#include "stats_functions.h"
+
+// Time range of a query in milliseconds since the recording started, to is
+// -1 for the end of the recording
+typedef struct {
+  int64_t fromMs;
+  int64_t toMs;
+  const char *metrics;  // Comma separated metric names, NULL for all
+  int summary;          // Min, max and average only, from the rollups
+} QueryRange;
+
+#define METRIC_SOURCES 64  // Recordings a merged recording may hold
+
+// What turning the records of one recording into metrics carries over from
+// one record to the next, per source of a merged recording
+typedef struct {
+  uint64_t prev[METRIC_SOURCES][CPU_FIELDS];  // Whole system counters of
+                                              // the last cpu record
+  uint8_t havePrev[METRIC_SOURCES];
+} MetricState;
+
+// Function prototypes
+int findMetric(const char *name, size_t length);
+const char *metricName(int metric);
+unsigned recordMetrics(MetricState *state, const RecordHeader *record,
+                       double *values);
+void selectNth(double *values, long low, long high, long k);
+void runQuery(const char *path, const QueryRange *range);
+#endif  // QUERY_H
@@ -0,0 +1,292 @@
+#define _GNU_SOURCE  // mremap
+
+#include "recording.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+_Static_assert(sizeof(RecordingHeader) <= RECORDING_HEADER_SIZE,
+               "recording header doesn't fit its reserved space");
+
+// Helper function that returns the file size holding the given slots.
+static size_t recordingSize(const RecordingHeader *header, uint64_t slots) {
+  return RECORDING_HEADER_SIZE + slots * header->slotSize;
+}
+
+// Allocate the file up to size bytes and map all of it. Blocks are allocated
+// right away so running out of disk fails here instead of faulting later.
+static void mapRecording(Recording *recording, size_t size) {
+  int error = posix_fallocate(recording->fd, 0, size);
+  if (error != 0) {
+    fprintf(stderr, "fallocate: %s\n", strerror(error));
+    exit(EXIT_FAILURE);
+  }
+  char *map;
+  if (recording->map == NULL) {
+    map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, recording->fd,
+               0);
+  } else {
+    map = mremap(recording->map, recording->mapSize, size, MREMAP_MAYMOVE);
+  }
+  if (map == MAP_FAILED) {
+    perror("mmap");
+    exit(EXIT_FAILURE);
+  }
+  recording->map = map;
+  recording->mapSize = size;
+  recording->header = (RecordingHeader *)map;
+}
+
+// Function to create a recording file with room for slots slots, layout
+// gives the slot size and describes what is recorded.
+void startRecording(Recording *recording, const char *path,
+                    const RecordingHeader *layout, uint64_t slots) {
+  recording->fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (recording->fd == -1) {
+    perror(path);
+    exit(EXIT_FAILURE);
+  }
+  recording->map = NULL;
+  recording->next = 0;
+  recording->records = 0;
+  recording->rawBytes = 0;
+  recording->storedBytes = 0;
+  recording->encodeUs = 0;
+  initCodec(&recording->codec);
+  mapRecording(recording, recordingSize(layout, slots));
+
+  char indexPath[PATH_MAX];
+  snprintf(indexPath, sizeof(indexPath), "%s.index", path);
+  recording->indexFd =
+      open(indexPath, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+  if (recording->indexFd == -1) {
+    perror(indexPath);
+    exit(EXIT_FAILURE);
+  }
+
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  RecordingHeader *header = recording->header;
+  *header = *layout;
+  memcpy(header->magic, RECORDING_MAGIC, sizeof(header->magic));
+  header->version = RECORDING_VERSION;
+  header->slots = slots;
+  header->committed = 0;
+  header->start_ns = (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Function to copy a record into the next free slots, or to encode it when
+// compressing. The file doubles when it is full.
+void appendRecording(Recording *recording, const RecordHeader *record) {
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  RecordingHeader *header = recording->header;
+  size_t total = sizeof(RecordHeader) + record->length;
+  uint64_t needed = (total + header->slotSize - 1) / header->slotSize;
+  if (header->codec == RECORDING_DELTA) {
+    needed = codecBound(record->length);  // At most, a byte per slot
+  }
+  if (recording->next + needed > header->slots) {
+    uint64_t slots = header->slots * 2;
+    if (slots < recording->next + needed) {
+      slots = recording->next + needed;
+    }
+    mapRecording(recording, recordingSize(header, slots));
+    header = recording->header;
+    header->slots = slots;
+  }
+
+  // Blocks are indexed before their first record, a reader seeking past
+  // the committed records finds nothing to read
+  if (recording->records % CODEC_BLOCK_RECORDS == 0) {
+    RecordingIndexEntry entry = {record->timestamp_ns, recording->next};
+    if (write(recording->indexFd, &entry, sizeof(entry)) != sizeof(entry)) {
+      perror("write");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  char *slot = recording->map + RECORDING_HEADER_SIZE +
+               recording->next * header->slotSize;
+  if (header->codec == RECORDING_DELTA) {
+    needed = encodeRecord(&recording->codec, record, (uint8_t *)slot);
+  } else {
+    // Everything but the type goes first, the type marks the slot complete
+    size_t skip = sizeof(record->type);
+    memcpy(slot + skip, (const char *)record + skip, total - skip);
+    __atomic_store_n((uint32_t *)slot, record->type, __ATOMIC_RELEASE);
+  }
+  recording->next += needed;
+  __atomic_store_n(&header->committed, recording->next, __ATOMIC_RELEASE);
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  recording->records++;
+  recording->rawBytes += total;
+  recording->storedBytes += needed * header->slotSize;
+  recording->encodeUs += (end.tv_sec - start.tv_sec) * 1e6 +
+                         (end.tv_nsec - start.tv_nsec) / 1e3;
+}
+
+// Function to finish a recording, the unused slots are cut off the file.
+void stopRecording(Recording *recording) {
+  if (recording->map == NULL) {
+    return;
+  }
+  size_t size = recordingSize(recording->header, recording->next);
+  recording->header->slots = recording->next;
+  munmap(recording->map, recording->mapSize);
+  recording->map = NULL;
+  freeCodec(&recording->codec);
+  close(recording->indexFd);
+  if (ftruncate(recording->fd, size) == -1) {
+    perror("ftruncate");
+  }
+  close(recording->fd);
+}
+
+// Map the index of a recording being read, a recording without one can only
+// be read from the start.
+static void openRecordingIndex(Recording *recording, const char *path) {
+  char indexPath[PATH_MAX];
+  struct stat st;
+  snprintf(indexPath, sizeof(indexPath), "%s.index", path);
+  recording->index = NULL;
+  recording->indexEntries = 0;
+  recording->indexFd = open(indexPath, O_RDONLY | O_CLOEXEC);
+  if (recording->indexFd == -1 || fstat(recording->indexFd, &st) == -1 ||
+      st.st_size < (off_t)sizeof(RecordingIndexEntry)) {
+    return;
+  }
+  void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED,
+                   recording->indexFd, 0);
+  if (map != MAP_FAILED) {
+    recording->index = map;
+    recording->indexEntries = st.st_size / sizeof(RecordingIndexEntry);
+  }
+}
+
+// Function to map an existing recording for reading, records are read from
+// the first slot on.
+void openRecording(Recording *recording, const char *path) {
+  recording->fd = open(path, O_RDONLY | O_CLOEXEC);
+  struct stat st;
+  if (recording->fd == -1 || fstat(recording->fd, &st) == -1) {
+    perror(path);
+    exit(EXIT_FAILURE);
+  }
+  if (st.st_size < RECORDING_HEADER_SIZE) {
+    fprintf(stderr, "%s: not a recording\n", path);
+    exit(EXIT_FAILURE);
+  }
+  recording->mapSize = st.st_size;
+  recording->map =
+      mmap(NULL, recording->mapSize, PROT_READ, MAP_SHARED, recording->fd, 0);
+  if (recording->map == MAP_FAILED) {
+    perror("mmap");
+    exit(EXIT_FAILURE);
+  }
+  recording->header = (RecordingHeader *)recording->map;
+  recording->next = 0;
+  initCodec(&recording->codec);
+  openRecordingIndex(recording, path);
+  const RecordingHeader *header = recording->header;
+  // Version 1 only differs by having no codec, which reads as raw
+  if (memcmp(header->magic, RECORDING_MAGIC, sizeof(header->magic)) != 0 ||
+      header->version < 1 || header->version > RECORDING_VERSION ||
+      header->slotSize == 0) {
+    fprintf(stderr, "%s: not a recording\n", path);
+    exit(EXIT_FAILURE);
+  }
+}
+
+// Function that returns the next complete record, or NULL at the end of the
+// recording. The record points into the mapping.
+const RecordHeader *readRecording(Recording *recording) {
+  const RecordingHeader *header = recording->header;
+  uint64_t committed = __atomic_load_n(&header->committed, __ATOMIC_ACQUIRE);
+  uint64_t inFile = (recording->mapSize - RECORDING_HEADER_SIZE) /
+                    header->slotSize;  // A crash may leave a short file
+  uint64_t end = committed < inFile ? committed : inFile;
+  if (recording->next >= end) {
+    return NULL;
+  }
+
+  const char *slot = recording->map + RECORDING_HEADER_SIZE +
+                     recording->next * header->slotSize;
+  if (header->codec == RECORDING_DELTA) {
+    size_t used;
+    const RecordHeader *record =
+        decodeRecord(&recording->codec, (const uint8_t *)slot,
+                     end - recording->next, &used);
+    if (record != NULL) {
+      recording->next += used;
+    }
+    return record;
+  }
+  const RecordHeader *record = (const RecordHeader *)slot;
+  if (__atomic_load_n(&record->type, __ATOMIC_ACQUIRE) == 0) {
+    return NULL;
+  }
+  uint64_t needed = (sizeof(RecordHeader) + (uint64_t)record->length +
+                     header->slotSize - 1) /
+                    header->slotSize;
+  if (recording->next + needed > end) {
+    return NULL;
+  }
+  recording->next += needed;
+  return record;
+}
+
+// Function to move the reading position to the block holding timestamp_ns,
+// found by a binary search of the index. Reading then starts up to a block
+// early, as records of different collectors can be a little out of order.
+void seekRecording(Recording *recording, int64_t timestamp_ns) {
+  size_t low = 0, high = recording->indexEntries;
+  while (low < high) {  // First entry past timestamp_ns
+    size_t middle = low + (high - low) / 2;
+    if (recording->index[middle].timestamp_ns <= timestamp_ns) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  recording->next = low >= 2 ? recording->index[low - 2].slot : 0;
+}
+
+// Function to unmap a recording opened for reading.
+void closeRecording(Recording *recording) {
+  if (recording->index != NULL) {
+    munmap((void *)recording->index,
+           recording->indexEntries * sizeof(RecordingIndexEntry));
+  }
+  if (recording->indexFd != -1) {
+    close(recording->indexFd);
+  }
+  munmap(recording->map, recording->mapSize);
+  recording->map = NULL;
+  close(recording->fd);
+  freeCodec(&recording->codec);
+}
+
+// Function to print how much the recording took and how long appending
+// records took.
+void printRecordingStats(const Recording *recording) {
+  if (recording->records == 0) {
+    return;
+  }
+  printf(
+      "Recording: %lu records, %lu KB raw, %lu KB stored (%.1fx), "
+      "%.2f us per record\n",
+      (unsigned long)recording->records,
+      (unsigned long)(recording->rawBytes / 1024),
+      (unsigned long)(recording->storedBytes / 1024),
+      (double)recording->rawBytes / recording->storedBytes,
+      recording->encodeUs / recording->records);
+}
@@ -0,0 +1,77 @@
+#ifndef RECORDING_H
+#define RECORDING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "codec.h"
+#include "collectors.h"
+
+#define RECORDING_MAGIC "SYSMONRC"
+#define RECORDING_VERSION 2
+#define RECORDING_HEADER_SIZE 128
+#define RECORDING_TYPES 8  // Record types the header has room for
+
+// How records are stored after the header
+#define RECORDING_RAW 0    // Whole records in fixed-size slots
+#define RECORDING_DELTA 1  // One byte slots holding a codec.c stream
+
+// Fixed header at the start of a recording file. The records follow in
+// slots of slotSize bytes, a record taking more than one slot continues in
+// the next ones. A slot's RecordHeader type is stored last, so a slot with a
+// zero type was never completed. Compressed recordings use one byte slots
+// holding the encoded stream, committed then counts the bytes of complete
+// records.
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t slotSize;
+  uint64_t slots;      // Slots allocated in the file
+  uint64_t committed;  // Slots holding complete records
+  int64_t start_ns;    // CLOCK_REALTIME when recording started
+  int32_t sample;
+  int32_t intervalMs;
+  uint32_t types;                         // Bit n set when type n is recorded
+  int32_t intervalsMs[RECORDING_TYPES];  // Per type, -1 for sampled once
+  uint32_t codec;                         // RECORDING_RAW or RECORDING_DELTA
+  uint32_t sources;  // Recordings merged into it, their index is in the
+                     // records' reserved field, 0 when not merged
+} RecordingHeader;
+
+// Entry of the sparse time index kept in FILE.index, one for the first
+// record of every block of CODEC_BLOCK_RECORDS records. A compressed stream
+// resets its codec at the same records, so decoding can start at any entry.
+typedef struct {
+  int64_t timestamp_ns;
+  uint64_t slot;
+} RecordingIndexEntry;
+
+// A recording being written or read through a shared mapping of the whole
+// file.
+typedef struct {
+  int fd;
+  char *map;
+  size_t mapSize;
+  RecordingHeader *header;
+  uint64_t next;  // First free slot, or the next one to read
+  CodecState codec;
+  uint64_t records;      // Records appended
+  uint64_t rawBytes;     // Their size before encoding
+  uint64_t storedBytes;  // and in the file
+  double encodeUs;       // Time spent appending them
+  int indexFd;
+  const RecordingIndexEntry *index;  // Mapped index when reading, or NULL
+  size_t indexEntries;
+} Recording;
+
+// Function prototypes
+void startRecording(Recording *recording, const char *path,
+                    const RecordingHeader *layout, uint64_t slots);
+void appendRecording(Recording *recording, const RecordHeader *record);
+void stopRecording(Recording *recording);
+void openRecording(Recording *recording, const char *path);
+const RecordHeader *readRecording(Recording *recording);
+void seekRecording(Recording *recording, int64_t timestamp_ns);
+void closeRecording(Recording *recording);
+void printRecordingStats(const Recording *recording);
+#endif  // RECORDING_H
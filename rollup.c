@@ -0,0 +1,183 @@
+#include "rollup.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define NS_PER_SEC 1000000000LL
+
+// Width and retention of every tier, finest first
+static const RollupTier tierLayout[ROLLUP_TIERS] = {
+    {.width_ns = 60 * NS_PER_SEC, .capacity = 7 * 24 * 60},  // A week
+    {.width_ns = 3600 * NS_PER_SEC, .capacity = 366 * 24},   // A year
+};
+
+// Helper function that returns the ring of a tier.
+static RollupBucket *tierRing(const Rollups *rollups, int tier) {
+  return (RollupBucket *)(rollups->map + rollups->header->tiers[tier].offset);
+}
+
+// Helper function to map a rollup file of the given size.
+static void mapRollups(Rollups *rollups, const char *path, int prot) {
+  rollups->map = mmap(NULL, rollups->mapSize, prot, MAP_SHARED, rollups->fd, 0);
+  if (rollups->map == MAP_FAILED) {
+    perror(path);
+    exit(EXIT_FAILURE);
+  }
+  rollups->header = (RollupHeader *)rollups->map;
+}
+
+// Function to create an empty rollup file. Its size is fixed by the tiers'
+// retention, so it never grows however long the recording runs.
+void createRollups(Rollups *rollups, const char *path) {
+  RollupHeader header = {.version = ROLLUP_VERSION,
+                         .metrics = ROLLUP_METRICS};
+  memcpy(header.magic, ROLLUP_MAGIC, sizeof(header.magic));
+  size_t size = sizeof(RollupHeader);
+  for (int t = 0; t < ROLLUP_TIERS; t++) {
+    header.tiers[t] = tierLayout[t];
+    header.tiers[t].offset = size;
+    size += tierLayout[t].capacity * sizeof(RollupBucket);
+  }
+
+  rollups->fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (rollups->fd == -1 || ftruncate(rollups->fd, size) == -1) {
+    perror(path);
+    exit(EXIT_FAILURE);
+  }
+  rollups->mapSize = size;
+  memset(rollups->dropped, 0, sizeof(rollups->dropped));
+  mapRollups(rollups, path, PROT_READ | PROT_WRITE);
+  *rollups->header = header;
+}
+
+// Function to map an existing rollup file for reading.
+void openRollups(Rollups *rollups, const char *path) {
+  struct stat st;
+  rollups->fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (rollups->fd == -1 || fstat(rollups->fd, &st) == -1) {
+    perror(path);
+    exit(EXIT_FAILURE);
+  }
+  rollups->mapSize = st.st_size;
+  if (rollups->mapSize < sizeof(RollupHeader)) {
+    fprintf(stderr, "%s: not a rollup file\n", path);
+    exit(EXIT_FAILURE);
+  }
+  mapRollups(rollups, path, PROT_READ);
+
+  const RollupHeader *header = rollups->header;
+  int valid = memcmp(header->magic, ROLLUP_MAGIC, sizeof(header->magic)) == 0 &&
+              header->version == ROLLUP_VERSION &&
+              header->metrics == ROLLUP_METRICS;
+  for (int t = 0; valid && t < ROLLUP_TIERS; t++) {
+    const RollupTier *tier = &header->tiers[t];
+    valid = tier->width_ns > 0 && tier->offset <= rollups->mapSize &&
+            tier->capacity <=
+                (rollups->mapSize - tier->offset) / sizeof(RollupBucket);
+  }
+  if (!valid) {
+    fprintf(stderr, "%s: not a rollup file\n", path);
+    exit(EXIT_FAILURE);
+  }
+}
+
+// Function to fold one sample into the bucket covering it in every tier. A
+// sample later than the newest bucket opens a new one, dropping the oldest
+// when the ring is full. A sample arriving after a later one, as collectors
+// finish out of order, goes to its retained bucket. Without one, as when it
+// falls in a gap no earlier sample opened a bucket for, it is counted as
+// dropped.
+void addRollup(Rollups *rollups, int metric, int64_t timestamp_ns,
+               double value) {
+  for (int t = 0; t < ROLLUP_TIERS; t++) {
+    RollupTier *tier = &rollups->header->tiers[t];
+    RollupBucket *ring = tierRing(rollups, t);
+    int64_t start_ns = timestamp_ns - timestamp_ns % tier->width_ns;
+
+    RollupBucket *bucket = NULL;
+    if (tier->opened == 0 ||
+        start_ns > ring[(tier->opened - 1) % tier->capacity].start_ns) {
+      bucket = &ring[tier->opened % tier->capacity];
+      memset(bucket, 0, sizeof(*bucket));
+      bucket->start_ns = start_ns;
+      tier->opened++;
+    } else {
+      uint64_t kept = rollupCount(rollups, t);
+      for (uint64_t k = 1; k <= kept; k++) {
+        RollupBucket *candidate =
+            &ring[(tier->opened - k) % tier->capacity];
+        if (candidate->start_ns <= start_ns) {
+          bucket = candidate->start_ns == start_ns ? candidate : NULL;
+          break;
+        }
+      }
+      if (bucket == NULL) {
+        // Older than what is retained, or in a gap with no bucket
+        rollups->dropped[t]++;
+        continue;
+      }
+    }
+
+    RollupCell *cell = &bucket->cells[metric];
+    if (cell->count == 0 || value < cell->min) {
+      cell->min = value;
+    }
+    if (cell->count == 0 || value > cell->max) {
+      cell->max = value;
+    }
+    cell->sum += value;
+    cell->count++;
+  }
+}
+
+// Function that returns the number of buckets a tier holds.
+uint64_t rollupCount(const Rollups *rollups, int tier) {
+  const RollupTier *layout = &rollups->header->tiers[tier];
+  return layout->opened < layout->capacity ? layout->opened
+                                           : layout->capacity;
+}
+
+// Function that returns the i-th bucket of a tier, 0 is the oldest.
+const RollupBucket *rollupBucket(const Rollups *rollups, int tier,
+                                 uint64_t i) {
+  const RollupTier *layout = &rollups->header->tiers[tier];
+  uint64_t first = layout->opened - rollupCount(rollups, tier);
+  return &tierRing(rollups, tier)[(first + i) % layout->capacity];
+}
+
+// Function to print how many buckets every tier holds, and how many samples
+// it dropped.
+void printRollupStats(const Rollups *rollups) {
+  if (rollups->map == NULL) {
+    return;
+  }
+  printf("Rollups:");
+  for (int t = 0; t < ROLLUP_TIERS; t++) {
+    const RollupTier *tier = &rollups->header->tiers[t];
+    long seconds = tier->width_ns / NS_PER_SEC;
+    printf("%s %lu of %lu buckets of %ld %s", t == 0 ? "" : ",",
+           (unsigned long)rollupCount(rollups, t),
+           (unsigned long)tier->capacity,
+           seconds % 3600 == 0 ? seconds / 3600 : seconds / 60,
+           seconds % 3600 == 0 ? "h" : "min");
+    if (rollups->dropped[t] > 0) {
+      printf(" (%lu samples dropped)", (unsigned long)rollups->dropped[t]);
+    }
+  }
+  printf("\n");
+}
+
+// Function to unmap a rollup file.
+void closeRollups(Rollups *rollups) {
+  if (rollups->map == NULL) {
+    return;
+  }
+  munmap(rollups->map, rollups->mapSize);
+  rollups->map = NULL;
+  close(rollups->fd);
+}
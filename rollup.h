@@ -0,0 +1,73 @@
+#ifndef ROLLUP_H
+#define ROLLUP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ROLLUP_MAGIC "SYSMONRU"
+#define ROLLUP_VERSION 1
+#define ROLLUP_TIERS 2
+
+// Metrics kept in the rollups of a recording
+enum {
+  ROLLUP_CPU_BUSY,    // Percent
+  ROLLUP_CPU_IOWAIT,  // Percent
+  ROLLUP_CPU_STEAL,   // Percent
+  ROLLUP_MEMORY_USED, // kB, total minus available
+  ROLLUP_SWAP_USED,   // kB
+  ROLLUP_USERS,
+  ROLLUP_METRICS
+};
+
+// Summary of the samples of one metric that fell in a bucket
+typedef struct {
+  uint32_t count;
+  uint32_t reserved;
+  double min;
+  double max;
+  double sum;
+} RollupCell;
+
+// One bucket of a tier, covering width_ns from start_ns
+typedef struct {
+  int64_t start_ns;
+  RollupCell cells[ROLLUP_METRICS];
+} RollupBucket;
+
+// A tier is a ring of capacity buckets of width_ns each, the oldest bucket is
+// dropped when a new one opens on a full ring.
+typedef struct {
+  int64_t width_ns;
+  uint64_t capacity;
+  uint64_t opened;  // Buckets opened, the newest at (opened - 1) % capacity
+  uint64_t offset;  // Where the ring starts in the file
+} RollupTier;
+
+// Header of a rollup file, the tier rings follow it.
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t metrics;
+  RollupTier tiers[ROLLUP_TIERS];
+} RollupHeader;
+
+// Rollup file mapped in memory, kept next to a recording
+typedef struct {
+  int fd;
+  char *map;
+  size_t mapSize;
+  RollupHeader *header;
+  uint64_t dropped[ROLLUP_TIERS];  // Samples no retained bucket took
+} Rollups;
+
+// Function prototypes
+void createRollups(Rollups *rollups, const char *path);
+void openRollups(Rollups *rollups, const char *path);
+void addRollup(Rollups *rollups, int metric, int64_t timestamp_ns,
+               double value);
+uint64_t rollupCount(const Rollups *rollups, int tier);
+const RollupBucket *rollupBucket(const Rollups *rollups, int tier,
+                                 uint64_t i);
+void printRollupStats(const Rollups *rollups);
+void closeRollups(Rollups *rollups);
+#endif  // ROLLUP_H
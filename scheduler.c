@@ -0,0 +1,162 @@
+#include "scheduler.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+// Helper function that returns a timespec in microseconds
+static double timespecUs(const struct timespec *ts) {
+  return ts->tv_sec * 1e6 + ts->tv_nsec / 1e3;
+}
+
+// Function to arm the timer so tick n is due n intervals from now. An interval
+// of 0 never waits.
+void startScheduler(Scheduler *scheduler, long intervalMs) {
+  scheduler->intervalMs = intervalMs;
+  scheduler->expirations = 0;
+  scheduler->ticks = 0;
+  scheduler->missed = 0;
+  scheduler->jitterSumUs = 0;
+  scheduler->jitterMaxUs = 0;
+  scheduler->timerFd = -1;
+  scheduler->watchCount = 0;
+  scheduler->epollFd = epoll_create1(EPOLL_CLOEXEC);
+  if (scheduler->epollFd == -1) {
+    perror("epoll_create1");
+    exit(EXIT_FAILURE);
+  }
+  if (intervalMs <= 0) {
+    return;
+  }
+
+  scheduler->timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+  if (scheduler->timerFd == -1) {
+    perror("timerfd");
+    exit(EXIT_FAILURE);
+  }
+  // Watches are numbered from 1 in the events, 0 is the timer
+  struct epoll_event event = {.events = EPOLLIN};
+  event.data.u32 = 0;
+  if (epoll_ctl(scheduler->epollFd, EPOLL_CTL_ADD, scheduler->timerFd,
+                &event) == -1) {
+    perror("epoll_ctl");
+    exit(EXIT_FAILURE);
+  }
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  struct itimerspec spec;
+  spec.it_interval.tv_sec = intervalMs / 1000;
+  spec.it_interval.tv_nsec = (intervalMs % 1000) * 1000000;
+  spec.it_value.tv_sec = now.tv_sec + spec.it_interval.tv_sec;
+  spec.it_value.tv_nsec = now.tv_nsec + spec.it_interval.tv_nsec;
+  if (spec.it_value.tv_nsec >= 1000000000) {
+    spec.it_value.tv_sec++;
+    spec.it_value.tv_nsec -= 1000000000;
+  }
+  scheduler->first = spec.it_value;
+  if (timerfd_settime(scheduler->timerFd, TFD_TIMER_ABSTIME, &spec, NULL) ==
+      -1) {
+    perror("timerfd_settime");
+    exit(EXIT_FAILURE);
+  }
+}
+
+// Function to run function with context whenever fd is readable while
+// waiting for a tick, after startScheduler.
+void watchScheduler(Scheduler *scheduler, int fd, WatchFunction function,
+                    void *context) {
+  if (scheduler->watchCount == SCHEDULER_WATCHES) {
+    fprintf(stderr, "Too many descriptors watched\n");
+    exit(EXIT_FAILURE);
+  }
+  struct epoll_event event = {.events = EPOLLIN};
+  event.data.u32 = scheduler->watchCount + 1;
+  if (epoll_ctl(scheduler->epollFd, EPOLL_CTL_ADD, fd, &event) == -1) {
+    perror("epoll_ctl");
+    exit(EXIT_FAILURE);
+  }
+  scheduler->watches[scheduler->watchCount] = function;
+  scheduler->contexts[scheduler->watchCount++] = context;
+}
+
+// Helper function to wait up to timeoutMs, -1 for ever, running the watches
+// that became readable. Returns the deadlines passed, 0 when none did.
+static uint64_t waitEvents(Scheduler *scheduler, int timeoutMs) {
+  struct epoll_event events[SCHEDULER_WATCHES + 1];
+  int ready =
+      epoll_wait(scheduler->epollFd, events, SCHEDULER_WATCHES + 1, timeoutMs);
+  if (ready == -1) {
+    if (errno == EINTR) {
+      return 0;  // Interrupted by Ctrl + C
+    }
+    perror("epoll_wait");
+    exit(EXIT_FAILURE);
+  }
+  uint64_t expired = 0;
+  for (int i = 0; i < ready; i++) {
+    uint32_t watch = events[i].data.u32;
+    if (watch > 0) {
+      scheduler->watches[watch - 1](scheduler->contexts[watch - 1]);
+    } else if (read(scheduler->timerFd, &expired, sizeof(expired)) !=
+               sizeof(expired)) {
+      expired = 0;
+    }
+  }
+  return expired;
+}
+
+// Function to block until the next tick is due, the first tick is due right
+// away
+void waitScheduler(Scheduler *scheduler) {
+  if (scheduler->ticks++ == 0 || scheduler->timerFd == -1) {
+    if (scheduler->watchCount > 0) {
+      waitEvents(scheduler, 0);  // Still serve what is pending
+    }
+    return;
+  }
+
+  uint64_t expired = 0;
+  while (expired == 0) {
+    expired = waitEvents(scheduler, -1);
+  }
+
+  // Jitter is measured against the latest deadline that passed
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  scheduler->expirations += expired;
+  scheduler->missed += expired - 1;
+  double deadlineUs = timespecUs(&scheduler->first) +
+                      (scheduler->expirations - 1) * scheduler->intervalMs * 1e3;
+  double jitterUs = timespecUs(&now) - deadlineUs;
+  scheduler->jitterSumUs += jitterUs;
+  if (jitterUs > scheduler->jitterMaxUs) {
+    scheduler->jitterMaxUs = jitterUs;
+  }
+}
+
+// Function to disarm the timer, the statistics stay available
+void stopScheduler(Scheduler *scheduler) {
+  if (scheduler->timerFd != -1) {
+    close(scheduler->timerFd);
+    scheduler->timerFd = -1;
+  }
+  if (scheduler->epollFd != -1) {
+    close(scheduler->epollFd);
+    scheduler->epollFd = -1;
+  }
+}
+
+// Function to print how many ticks fired, were missed and how late they were
+void printSchedulerStats(const Scheduler *scheduler) {
+  uint64_t waited = scheduler->expirations - scheduler->missed;  // Wake ups
+  printf("Scheduler: %lu ticks every %ld ms, %lu missed, jitter %.0f us avg "
+         "%.0f us max\n",
+         (unsigned long)scheduler->ticks, scheduler->intervalMs,
+         (unsigned long)scheduler->missed,
+         waited ? scheduler->jitterSumUs / waited : 0.00,
+         scheduler->jitterMaxUs);
+}
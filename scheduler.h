@@ -0,0 +1,38 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdint.h>
+#include <time.h>
+
+#define SCHEDULER_WATCHES 4
+
+// Function run when a watched descriptor is readable
+typedef void (*WatchFunction)(void *context);
+
+// Fires ticks on a fixed grid of absolute CLOCK_MONOTONIC deadlines, so the
+// time spent collecting and rendering never pushes later ticks back. Ticks
+// that pass while the monitor is busy are counted as missed, not made up.
+// Watched descriptors are served while waiting for a tick.
+typedef struct {
+  int timerFd;
+  int epollFd;
+  int watchCount;
+  WatchFunction watches[SCHEDULER_WATCHES];
+  void *contexts[SCHEDULER_WATCHES];
+  long intervalMs;
+  struct timespec first;  // Deadline of the second tick
+  uint64_t expirations;   // Deadlines passed so far
+  uint64_t ticks;         // Ticks handed out by waitScheduler
+  uint64_t missed;        // Deadlines that passed without a tick
+  double jitterSumUs;     // Wake up time past the deadline, summed
+  double jitterMaxUs;
+} Scheduler;
+
+// Function prototypes
+void startScheduler(Scheduler *scheduler, long intervalMs);
+void watchScheduler(Scheduler *scheduler, int fd, WatchFunction function,
+                    void *context);
+void waitScheduler(Scheduler *scheduler);
+void stopScheduler(Scheduler *scheduler);
+void printSchedulerStats(const Scheduler *scheduler);
+#endif  // SCHEDULER_H
@@ -0,0 +1,256 @@
+#include "screen.h"
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// The frame being drawn and the one the terminal shows, as rows of
+// SCREEN_COLUMNS cells. Drawing only changes cells, flushing sends the
+// cells that differ from what is shown in a single write.
+typedef struct {
+  int rows;
+  Cell *cells;
+  Cell *shown;
+  int row;     // Cursor, from 0
+  int column;
+  int repaint;  // Send every row on the next flush
+  char *out;    // Escape sequences and text of a frame
+  size_t outCapacity;
+  uint64_t frames;  // Flushes that wrote something
+  uint64_t bytes;
+  size_t maxBytes;
+} Screen;
+
+static Screen screen;
+
+// Function to set up a blank screen of rows rows, matching a terminal that
+// was just cleared.
+void initScreen(int rows) {
+  free(screen.cells);
+  free(screen.shown);
+  free(screen.out);
+  memset(&screen, 0, sizeof(screen));
+  screen.rows = rows > 0 ? rows : 1;
+  size_t size = (size_t)screen.rows * SCREEN_COLUMNS;
+  // A cell takes at most 4 bytes, and a span at most a cursor move per
+  // SCREEN_SPAN_GAP cells on top
+  screen.outCapacity = (size_t)screen.rows * (4 * SCREEN_COLUMNS + 64);
+  screen.cells = malloc(size * sizeof(Cell));
+  screen.shown = malloc(size * sizeof(Cell));
+  screen.out = malloc(screen.outCapacity);
+  if (screen.cells == NULL || screen.shown == NULL || screen.out == NULL) {
+    perror("malloc");
+    exit(EXIT_FAILURE);
+  }
+  for (size_t i = 0; i < size; i++) {
+    screen.cells[i] = screen.shown[i] = ' ';
+  }
+}
+
+// Function to move the cursor, rows and columns count from 1 like the ANSI
+// cursor position sequence. Rows past the screen stay on its last row, as a
+// terminal keeps them on its bottom line.
+void moveCursor(int row, int column) {
+  row = row < 1 ? 1 : row;
+  screen.row = row > screen.rows ? screen.rows - 1 : row - 1;
+  screen.column = column < 1 ? 0 : column - 1;
+}
+
+// Function to draw formatted text at the cursor, a UTF-8 sequence takes one
+// cell. A newline goes to the start of the next row and a tab to the next
+// multiple of 8 columns, without touching the cells skipped, like they do on
+// a terminal.
+void screenPrintf(const char *format, ...) {
+  char text[1024];
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(text, sizeof(text), format, args);
+  va_end(args);
+  if (length >= (int)sizeof(text)) {
+    length = sizeof(text) - 1;
+  }
+
+  Cell *row = screen.cells + (size_t)screen.row * SCREEN_COLUMNS;
+  for (int i = 0; i < length; i++) {
+    if (text[i] == '\n') {
+      if (screen.row < screen.rows - 1) {
+        screen.row++;
+        row += SCREEN_COLUMNS;
+      }
+      screen.column = 0;
+    } else if (text[i] == '\t') {
+      screen.column = (screen.column / 8 + 1) * 8;
+    } else {
+      Cell cell = (unsigned char)text[i];
+      for (int shift = 8; (unsigned char)text[i] >= 0xc0 && shift < 32 &&
+                          ((unsigned char)text[i + 1] & 0xc0) == 0x80;
+           shift += 8) {
+        cell |= (Cell)(unsigned char)text[++i] << shift;
+      }
+      if (screen.column < SCREEN_COLUMNS) {
+        row[screen.column] = cell;
+      }
+      screen.column++;
+    }
+  }
+}
+
+// Function to copy count cells to the cursor, cut off at the end of the row.
+void drawCells(const Cell *cells, int count) {
+  if (screen.column < SCREEN_COLUMNS) {
+    int fits = SCREEN_COLUMNS - screen.column;
+    memcpy(screen.cells + (size_t)screen.row * SCREEN_COLUMNS + screen.column,
+           cells, (count < fits ? count : fits) * sizeof(Cell));
+  }
+  screen.column += count;
+}
+
+// Function to blank the cursor's row from the cursor to its end.
+void clearToEnd() {
+  Cell *row = screen.cells + (size_t)screen.row * SCREEN_COLUMNS;
+  for (int column = screen.column; column < SCREEN_COLUMNS; column++) {
+    row[column] = ' ';
+  }
+}
+
+// Function to insert count blank rows before row, counted from 1, the rows
+// from there on move down and the screen grows. The terminal is sent every
+// row on the next flush, as what it shows moved.
+void insertRows(int row, int count) {
+  int at = row < 1 ? 0 : row > screen.rows ? screen.rows : row - 1;
+  int rows = screen.rows + count;
+  screen.cells = realloc(screen.cells,
+                         (size_t)rows * SCREEN_COLUMNS * sizeof(Cell));
+  screen.shown = realloc(screen.shown,
+                         (size_t)rows * SCREEN_COLUMNS * sizeof(Cell));
+  screen.outCapacity = (size_t)rows * (4 * SCREEN_COLUMNS + 64);
+  screen.out = realloc(screen.out, screen.outCapacity);
+  if (screen.cells == NULL || screen.shown == NULL || screen.out == NULL) {
+    perror("realloc");
+    exit(EXIT_FAILURE);
+  }
+  memmove(screen.cells + (size_t)(at + count) * SCREEN_COLUMNS,
+          screen.cells + (size_t)at * SCREEN_COLUMNS,
+          (size_t)(screen.rows - at) * SCREEN_COLUMNS * sizeof(Cell));
+  for (size_t i = (size_t)at * SCREEN_COLUMNS;
+       i < (size_t)(at + count) * SCREEN_COLUMNS; i++) {
+    screen.cells[i] = ' ';
+  }
+  screen.rows = rows;
+  if (screen.row >= at) {
+    screen.row += count;
+  }
+  screen.repaint = 1;
+}
+
+// Function to send every row on the next flush, whatever the terminal shows.
+void repaintScreen() { screen.repaint = 1; }
+
+// Helper function to append a cursor move to row and column, from 0.
+static char *putMove(char *out, int row, int column) {
+  return out + sprintf(out, "\033[%d;%dH", row + 1, column + 1);
+}
+
+// Helper function to append the text of count cells.
+static char *putCells(char *out, const Cell *cells, int count) {
+  for (int i = 0; i < count; i++) {
+    Cell cell = cells[i];
+    do {
+      *out++ = (char)(cell & 0xff);
+      cell >>= 8;
+    } while (cell != 0);
+  }
+  return out;
+}
+
+// Function to bring the terminal up to date with the frame. Changed cells of
+// a row are gathered into spans, a run of unchanged cells shorter than a
+// cursor move stays inside the span, and every span becomes a cursor move and
+// its text. The whole frame goes out in one write. Returns the bytes written.
+size_t flushScreen() {
+  char *out = screen.out;
+  for (int r = 0; r < screen.rows; r++) {
+    const Cell *cells = screen.cells + (size_t)r * SCREEN_COLUMNS;
+    const Cell *shown = screen.shown + (size_t)r * SCREEN_COLUMNS;
+    if (screen.repaint) {
+      int end = SCREEN_COLUMNS;
+      while (end > 0 && cells[end - 1] == ' ') {
+        end--;
+      }
+      out = putMove(out, r, 0);
+      out = putCells(out, cells, end);
+      memcpy(out, "\033[K", 3);
+      out += 3;
+      continue;
+    }
+    if (memcmp(cells, shown, SCREEN_COLUMNS * sizeof(Cell)) == 0) {
+      continue;
+    }
+    int column = 0;
+    while (column < SCREEN_COLUMNS) {
+      if (cells[column] == shown[column]) {
+        column++;
+        continue;
+      }
+      int start = column, end = column + 1;
+      for (column++; column < SCREEN_COLUMNS && column - end < SCREEN_SPAN_GAP;
+           column++) {
+        if (cells[column] != shown[column]) {
+          end = column + 1;
+        }
+      }
+      out = putMove(out, r, start);
+      out = putCells(out, cells + start, end - start);
+      column = end;
+    }
+  }
+  screen.repaint = 0;
+  if (out == screen.out) {
+    return 0;
+  }
+  out = putMove(out, screen.rows, 0);  // Below the frame, as printing left it
+  memcpy(screen.shown, screen.cells,
+         (size_t)screen.rows * SCREEN_COLUMNS * sizeof(Cell));
+
+  // Output printed with stdio before the frame has to go out first
+  fflush(stdout);
+  size_t total = out - screen.out, written = 0;
+  while (written < total) {
+    ssize_t nbytes =
+        write(STDOUT_FILENO, screen.out + written, total - written);
+    if (nbytes == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("write");
+      exit(EXIT_FAILURE);
+    }
+    written += nbytes;
+  }
+  screen.frames++;
+  screen.bytes += total;
+  if (total > screen.maxBytes) {
+    screen.maxBytes = total;
+  }
+  return total;
+}
+
+// Function to print how many bytes the frames took.
+void printScreenStats() {
+  printf("Screen: %lu frames, %.0f bytes per frame avg, %zu max\n",
+         (unsigned long)screen.frames,
+         screen.frames ? (double)screen.bytes / screen.frames : 0.0,
+         screen.maxBytes);
+}
+
+// Function to release the frames.
+void freeScreen() {
+  free(screen.cells);
+  free(screen.shown);
+  free(screen.out);
+  memset(&screen, 0, sizeof(screen));
+}
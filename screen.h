@@ -0,0 +1,26 @@
+#ifndef SCREEN_H
+#define SCREEN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SCREEN_COLUMNS 256  // Longer lines are cut off
+#define SCREEN_SPAN_GAP 8   // Unchanged cells cheaper to resend than skip
+
+// One character on the screen, the bytes of its UTF-8 encoding from the
+// lowest byte up
+typedef uint32_t Cell;
+
+// Function prototypes
+void initScreen(int rows);
+void moveCursor(int row, int column);
+void screenPrintf(const char *format, ...)
+    __attribute__((format(printf, 1, 2)));
+void drawCells(const Cell *cells, int count);
+void clearToEnd();
+void insertRows(int row, int count);
+void repaintScreen();
+size_t flushScreen();
+void printScreenStats();
+void freeScreen();
+#endif  // SCREEN_H
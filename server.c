@@ -0,0 +1,218 @@
+#define _GNU_SOURCE  // accept4
+
+#include "server.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SERVER_LISTEN (SERVER_CLIENTS + 1)  // Event data of the listener
+
+// Helper function to add a descriptor to the server's epoll, data tells the
+// events apart.
+static void watchFd(Server *server, int fd, uint32_t data) {
+  struct epoll_event event = {.events = EPOLLIN};
+  event.data.u32 = data;
+  if (epoll_ctl(server->epollFd, EPOLL_CTL_ADD, fd, &event) == -1) {
+    perror("epoll_ctl");
+    exit(EXIT_FAILURE);
+  }
+}
+
+// Helper function that returns the monotonic time in milliseconds.
+static int64_t nowMs() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+// Helper function to close a client and free its slot.
+static void closeClient(Server *server, int slot) {
+  close(server->clients[slot]);  // Also leaves the epoll
+  server->clients[slot] = -1;
+}
+
+// Helper function to close the clients that didn't send their request in
+// time, so they can't keep their slots forever.
+static void expireClients(Server *server) {
+  int64_t now = nowMs();
+  for (int i = 0; i < SERVER_CLIENTS; i++) {
+    if (server->clients[i] != -1 &&
+        now - server->acceptedMs[i] >= SERVER_DEADLINE_MS) {
+      closeClient(server, i);
+      server->expired++;
+    }
+  }
+}
+
+// Helper function that returns the port of an address, exits when it isn't
+// a number from 1 to 65535.
+static uint16_t parsePort(const char *address, const char *port) {
+  char *end;
+  errno = 0;
+  long value = strtol(port, &end, 10);
+  if (errno != 0 || end == port || *end != '\0' || value < 1 ||
+      value > 65535) {
+    fprintf(stderr, "%s: invalid port\n", address);
+    exit(EXIT_FAILURE);
+  }
+  return value;
+}
+
+// Function to listen on an address, a path for a unix socket or a port,
+// optionally after "127.0.0.1:", as only loopback is served.
+void startServer(Server *server, const char *address) {
+  memset(server, 0, sizeof(*server));
+  for (int i = 0; i < SERVER_CLIENTS; i++) {
+    server->clients[i] = -1;
+  }
+
+  int bound;
+  if (strchr(address, '/') != NULL) {
+    struct sockaddr_un local = {.sun_family = AF_UNIX};
+    if (strlen(address) >= sizeof(local.sun_path)) {
+      fprintf(stderr, "%s: path too long\n", address);
+      exit(EXIT_FAILURE);
+    }
+    strcpy(local.sun_path, address);
+    unlink(address);  // Left behind by an earlier run
+    server->path = address;
+    server->listenFd =
+        socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    bound = server->listenFd != -1 &&
+            bind(server->listenFd, (struct sockaddr *)&local,
+                 sizeof(local)) == 0;
+  } else {
+    const char *port = strrchr(address, ':');
+    struct sockaddr_in local = {.sin_family = AF_INET};
+    local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    local.sin_port =
+        htons(parsePort(address, port != NULL ? port + 1 : address));
+    server->listenFd =
+        socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int reuse = 1;
+    setsockopt(server->listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse,
+               sizeof(reuse));
+    bound = server->listenFd != -1 &&
+            bind(server->listenFd, (struct sockaddr *)&local,
+                 sizeof(local)) == 0;
+  }
+  if (!bound || listen(server->listenFd, SERVER_CLIENTS) == -1) {
+    perror(address);
+    exit(EXIT_FAILURE);
+  }
+
+  server->epollFd = epoll_create1(EPOLL_CLOEXEC);
+  if (server->epollFd == -1) {
+    perror("epoll_create1");
+    exit(EXIT_FAILURE);
+  }
+  watchFd(server, server->listenFd, SERVER_LISTEN);
+  updateServer(server);
+}
+
+// Function to render the response every scrape gets until the next tick,
+// from the latest value of every metric. Clients past their deadline are
+// closed every tick.
+void updateServer(Server *server) {
+  expireClients(server);
+  char body[FORMAT_EXPOSITION];
+  size_t length = formatExposition(body);
+  int header = snprintf(server->page, sizeof(server->page),
+                        "HTTP/1.0 200 OK\r\n"
+                        "Content-Type: text/plain; version=0.0.4\r\n"
+                        "Content-Length: %zu\r\n"
+                        "Connection: close\r\n\r\n",
+                        length);
+  memcpy(server->page + header, body, length);
+  server->length = header + length;
+}
+
+// Helper function to read what a client sent, and answer once its request
+// is complete. The request itself doesn't matter, every path gets the
+// metrics.
+static void serveClient(Server *server, int slot) {
+  int fd = server->clients[slot];
+  char request[2048];
+  ssize_t nbytes = read(fd, request, sizeof(request));
+  if (nbytes == -1 && (errno == EAGAIN || errno == EINTR)) {
+    return;
+  }
+  // Headers end with an empty line, a request may take several reads
+  int complete =
+      nbytes <= 0 ||
+      (nbytes >= 4 && memcmp(request + nbytes - 4, "\r\n\r\n", 4) == 0) ||
+      (nbytes >= 2 && memcmp(request + nbytes - 2, "\n\n", 2) == 0);
+  if (!complete) {
+    return;
+  }
+  if (nbytes > 0) {
+    // A fresh socket's buffer takes the whole page
+    if (write(fd, server->page, server->length) == (ssize_t)server->length) {
+      server->scrapes++;
+    }
+  }
+  closeClient(server, slot);
+}
+
+// Function to accept new scrapes and answer the ones whose request arrived,
+// without blocking. Clients past their deadline are closed before accepting,
+// to make room. Run by the scheduler when the server's epoll is readable.
+void serveScrapes(void *context) {
+  Server *server = context;
+  struct epoll_event events[SERVER_CLIENTS + 1];
+  int ready = epoll_wait(server->epollFd, events, SERVER_CLIENTS + 1, 0);
+  for (int i = 0; i < ready; i++) {
+    uint32_t slot = events[i].data.u32;
+    if (slot != SERVER_LISTEN) {
+      serveClient(server, slot);
+      continue;
+    }
+    expireClients(server);
+    int fd;
+    while ((fd = accept4(server->listenFd, NULL, NULL,
+                         SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1) {
+      int free = 0;
+      while (free < SERVER_CLIENTS && server->clients[free] != -1) {
+        free++;
+      }
+      if (free == SERVER_CLIENTS) {
+        close(fd);
+        server->refused++;
+        continue;
+      }
+      server->clients[free] = fd;
+      server->acceptedMs[free] = nowMs();
+      watchFd(server, fd, free);
+    }
+  }
+}
+
+// Function to close the endpoint and every client still connected.
+void stopServer(Server *server) {
+  for (int i = 0; i < SERVER_CLIENTS; i++) {
+    if (server->clients[i] != -1) {
+      close(server->clients[i]);
+    }
+  }
+  close(server->epollFd);
+  close(server->listenFd);
+  if (server->path != NULL) {
+    unlink(server->path);
+  }
+}
+
+// Function to print how many scrapes were answered.
+void printServerStats(const Server *server) {
+  printf("Server: %lu scrapes answered, %lu refused, %lu expired, "
+         "%zu bytes each\n",
+         (unsigned long)server->scrapes, (unsigned long)server->refused,
+         (unsigned long)server->expired, server->length);
+}
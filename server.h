@@ -0,0 +1,35 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "format.h"
+
+#define SERVER_CLIENTS 16        // Scrapes handled at once, more are refused
+#define SERVER_DEADLINE_MS 5000  // For a scrape to send its request
+#define SERVER_PAGE (FORMAT_EXPOSITION + 256)
+
+// Metrics endpoint on a unix socket or a loopback port. Every tick renders
+// the whole HTTP response once, a scrape is then answered with a single
+// write of it.
+typedef struct {
+  int listenFd;
+  int epollFd;       // The listening socket and the clients sending requests
+  const char *path;  // Unix socket to remove when stopping, or NULL
+  int clients[SERVER_CLIENTS];
+  int64_t acceptedMs[SERVER_CLIENTS];  // When each client was accepted
+  char page[SERVER_PAGE];
+  size_t length;
+  uint64_t scrapes;
+  uint64_t refused;
+  uint64_t expired;
+} Server;
+
+// Function prototypes
+void startServer(Server *server, const char *address);
+void updateServer(Server *server);
+void serveScrapes(void *context);
+void stopServer(Server *server);
+void printServerStats(const Server *server);
+#endif  // SERVER_H
@@ -0,0 +1,122 @@
+#include "sessions.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utmp.h>
+
+// Helper function to drop the current mapping
+static void unmapSessions(SessionCache *cache) {
+  if (cache->map != NULL) {
+    munmap((void *)cache->map, cache->mapSize);
+    cache->map = NULL;
+    cache->mapSize = 0;
+  }
+}
+
+// Helper function to replace the snapshot with the users found in the
+// mapping
+static void parseSessions(SessionCache *cache) {
+  const struct utmp *entries = cache->map;
+  size_t count = cache->mapSize / sizeof(struct utmp);
+
+  uint32_t users = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (entries[i].ut_type == USER_PROCESS) {
+      users++;
+    }
+  }
+
+  size_t size = sizeof(UsersSample) + users * sizeof(UserEntry);
+  UsersSample *sample = malloc(size);
+  if (sample == NULL) {
+    perror("malloc");
+    exit(EXIT_FAILURE);
+  }
+  sample->count = 0;
+  for (size_t i = 0; i < count; i++) {
+    const struct utmp *entry = &entries[i];
+    if (entry->ut_type != USER_PROCESS) {
+      continue;
+    }
+    // Copy the user information, utmp strings aren't always terminated
+    UserEntry *user = &sample->users[sample->count++];
+    snprintf(user->user, sizeof(user->user), "%.*s",
+             (int)sizeof(entry->ut_user), entry->ut_user);
+    snprintf(user->line, sizeof(user->line), "%.*s",
+             (int)sizeof(entry->ut_line), entry->ut_line);
+    snprintf(user->host, sizeof(user->host), "%.*s",
+             (int)sizeof(entry->ut_host), entry->ut_host);
+  }
+
+  free(cache->users);
+  cache->users = sample;
+  cache->size = size;
+  cache->generation++;
+}
+
+// Function to set up an empty cache for the given utmp file, the first
+// refresh reads it
+void initSessions(SessionCache *cache, const char *path) {
+  memset(cache, 0, sizeof(*cache));
+  cache->path = path;
+  cache->inode = (ino_t)-1;
+  cache->size = sizeof(UsersSample);
+  cache->users = calloc(1, cache->size);
+  if (cache->users == NULL) {
+    perror("calloc");
+    exit(EXIT_FAILURE);
+  }
+}
+
+// Function to bring the snapshot up to date, costs a single stat() when the
+// utmp file hasn't changed. Returns 1 if the snapshot was rebuilt.
+int refreshSessions(SessionCache *cache) {
+  struct stat st;
+  if (stat(cache->path, &st) == -1) {
+    // No utmp file (containers, minimal systems), nobody is logged in
+    if (cache->inode == (ino_t)-1 && cache->generation > 0) {
+      return 0;
+    }
+    unmapSessions(cache);
+    cache->inode = (ino_t)-1;
+    cache->mapSize = 0;
+    parseSessions(cache);
+    return 1;
+  }
+  if (st.st_ino == cache->inode && st.st_size == cache->fileSize &&
+      st.st_mtim.tv_sec == cache->mtime.tv_sec &&
+      st.st_mtim.tv_nsec == cache->mtime.tv_nsec) {
+    return 0;
+  }
+
+  // utmp is rewritten in place and may grow, map it again at its new size
+  unmapSessions(cache);
+  cache->inode = st.st_ino;
+  cache->fileSize = st.st_size;
+  cache->mtime = st.st_mtim;
+  int fd = open(cache->path, O_RDONLY | O_CLOEXEC);
+  if (fd != -1 && st.st_size >= (off_t)sizeof(struct utmp)) {
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map != MAP_FAILED) {
+      cache->map = map;
+      cache->mapSize = st.st_size;
+    }
+  }
+  if (fd != -1) {
+    close(fd);  // The mapping stays valid without the descriptor
+  }
+  parseSessions(cache);
+  return 1;
+}
+
+// Function to release the mapping and the snapshot
+void freeSessions(SessionCache *cache) {
+  unmapSessions(cache);
+  free(cache->users);
+  cache->users = NULL;
+}
@@ -0,0 +1,30 @@
+#ifndef SESSIONS_H
+#define SESSIONS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include "stats_functions.h"
+
+// Snapshot of the logged in users, built from a memory mapping of the utmp
+// file and rebuilt only when a stat() of the file shows it changed. The
+// user count and the user list always come from the same snapshot.
+typedef struct {
+  const char *path;
+  const void *map;
+  size_t mapSize;
+  ino_t inode;
+  off_t fileSize;
+  struct timespec mtime;
+  UsersSample *users;  // Current snapshot
+  size_t size;         // Size of the snapshot in bytes
+  uint64_t generation;  // Incremented every time the snapshot is rebuilt
+} SessionCache;
+
+// Function prototypes
+void initSessions(SessionCache *cache, const char *path);
+int refreshSessions(SessionCache *cache);
+void freeSessions(SessionCache *cache);
+#endif  // SESSIONS_H
@@ -0,0 +1,101 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+// Latest sample of a running monitor, published in POSIX shared memory by
+// publish.c. Readers only need this header: openSnapshot() once, then
+// readSnapshot() as often as wanted, which makes no system call and never
+// blocks the monitor. Build readers with -lrt on glibc before 2.34.
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define SNAPSHOT_NAME "/sysmon"  // Default shared memory object
+#define SNAPSHOT_MAGIC "SYSMONSS"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_MEM_FIELDS 12  // MEM_FIELDS when version 1 was released
+#define SNAPSHOT_RETRIES 1000000  // Copies tried before giving up
+
+// Bits of Snapshot.valid, set once the value was sampled
+#define SNAPSHOT_CPU 1u
+#define SNAPSHOT_MEMORY 2u
+#define SNAPSHOT_USERS 4u
+
+// The values published, cpu usage is in percent over the last cpu interval
+// and memory in kB, indexed like the MEM_ fields of stats_functions.h
+typedef struct {
+  int64_t timestamp_ns;  // CLOCK_REALTIME of the newest record
+  uint64_t tick;
+  uint32_t valid;
+  int32_t num_cpus;
+  double cpu_busy;
+  double cpu_iowait;
+  double cpu_steal;
+  double cpu_guest;
+  uint64_t memory_kb[SNAPSHOT_MEM_FIELDS];
+  uint32_t users;
+  uint32_t reserved;
+} Snapshot;
+
+// Layout of the shared memory object. The writer makes sequence odd before
+// changing the snapshot and even again after, so a reader seeing the same
+// even sequence before and after its copy has a consistent one.
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t size;  // sizeof(Snapshot)
+  uint64_t sequence;
+  int32_t owner;  // Pid of the monitor publishing it
+  uint32_t reserved;
+  uint64_t padding[4];  // The snapshot starts on its own cache line
+  Snapshot snapshot;
+} SharedSnapshot;
+
+// Function to map a published snapshot for reading, returns NULL when there
+// is none or it has another layout.
+static inline const SharedSnapshot *openSnapshot(const char *name) {
+  int fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+  if (fd == -1) {
+    return NULL;
+  }
+  void *map = mmap(NULL, sizeof(SharedSnapshot), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    return NULL;
+  }
+  const SharedSnapshot *shared = (const SharedSnapshot *)map;
+  if (memcmp(shared->magic, SNAPSHOT_MAGIC, sizeof(shared->magic)) != 0 ||
+      shared->version != SNAPSHOT_VERSION ||
+      shared->size != sizeof(Snapshot)) {
+    munmap(map, sizeof(SharedSnapshot));
+    return NULL;
+  }
+  return shared;
+}
+
+// Function to copy a consistent snapshot, retrying while the writer is
+// changing it. Returns the sequence of the copy, 0 before the first sample
+// or when the writer died halfway through one.
+static inline uint64_t readSnapshot(const SharedSnapshot *shared,
+                                    Snapshot *snapshot) {
+  for (long retry = 0; retry < SNAPSHOT_RETRIES; retry++) {
+    uint64_t before = __atomic_load_n(&shared->sequence, __ATOMIC_ACQUIRE);
+    if (before & 1) {
+      continue;
+    }
+    memcpy(snapshot, &shared->snapshot, sizeof(*snapshot));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&shared->sequence, __ATOMIC_RELAXED) == before) {
+      return before;
+    }
+  }
+  return 0;
+}
+
+// Function to unmap a snapshot opened for reading.
+static inline void closeSnapshot(const SharedSnapshot *shared) {
+  munmap((void *)shared, sizeof(SharedSnapshot));
+}
+#endif  // SNAPSHOT_H
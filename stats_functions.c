@@ -1,229 +1,434 @@
 #include "stats_functions.h"
 
+#include "chart.h"
+#include "proc_reader.h"
+#include "screen.h"
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/resource.h>
-#include <sys/sysinfo.h>
 #include <sys/types.h>
 #include <sys/utsname.h>
 #include <unistd.h>
 #include <utmp.h>
 
-// Function to print uptime
-void printUptime() {
-  FILE *uptime_file = fopen("/proc/uptime", "r");  // Open /proc/uptime
-
-  double uptime_seconds;
-  fscanf(uptime_file, "%lf", &uptime_seconds);  // Scan for seconds
-  fclose(uptime_file);
+// /proc files read by the collectors, kept open for the whole run
+static ProcFile statFile = PROC_FILE("/proc/stat");
+static ProcFile uptimeFile = PROC_FILE("/proc/uptime");
+static ProcFile meminfoFile = PROC_FILE("/proc/meminfo");
+
+// Function to open the /proc files once, before the collectors fork, so the
+// children share the descriptors instead of opening them every sample
+void openProcFiles() {
+  openProcFile(&statFile);
+  openProcFile(&uptimeFile);
+  openProcFile(&meminfoFile);
+}
 
+// Function to print uptime
+void printUptime(unsigned long long uptime_seconds) {
   // Calculate days, hours, minutes, and seconds
-  unsigned long long days = (unsigned long long)(uptime_seconds / (3600 * 24));
-  unsigned long long hours =
-      (unsigned long long)((int)uptime_seconds % (3600 * 24)) / 3600;
-  unsigned long long minutes =
-      (unsigned long long)((int)uptime_seconds % 3600) / 60;
-  unsigned long long seconds = (unsigned long long)uptime_seconds % 60;
+  unsigned long long days = uptime_seconds / (3600 * 24);
+  unsigned long long hours = uptime_seconds % (3600 * 24) / 3600;
+  unsigned long long minutes = uptime_seconds % 3600 / 60;
+  unsigned long long seconds = uptime_seconds % 60;
 
   // Calculate total time in hours, minutes, and seconds
   unsigned long long totalHours = (days * 24) + hours;
 
   // Print the result
-  printf(
+  screenPrintf(
       "System running since last reboot: %llu days %02llu:%02llu:%02llu "
       "(%02llu:%02llu:%02llu)\n",
       days, hours, minutes, seconds, totalHours, minutes, seconds);
 }
 
-// Function to print all system information
-void printSystem() {
+// Function to sample the system information and uptime
+void sampleSystem(SystemSample *sample) {
   // Use sys/utsname.h to get system data.
-  struct utsname systemData;
-  uname(&systemData);
-  printf("### System Information ###\n");
-  printf("System Name = %s\n", systemData.sysname);
-  printf("Machine Name = %s\n", systemData.nodename);
-  printf("Version = %s\n", systemData.version);
-  printf("Release = %s\n", systemData.release);
-  printf("System Name = %s\n", systemData.sysname);
-  printf("Architecture = %s\n", systemData.machine);
-  printUptime();  // Print uptime whenever system information is printed.
-}
-
-// Function to get cpu usage
-double getUsage() {
-  FILE *file = fopen("/proc/stat", "r");
-  if (file == NULL) {
-    perror("Error opening /proc/stat");
-    return -1;
-  }
+  uname(&sample->uts);
 
-  char line[256];
-  fgets(line, sizeof(line), file);
+  char buffer[128];
+  readProcFile(&uptimeFile, buffer, sizeof(buffer));  // Read /proc/uptime
 
-  long prev_user, prev_nice, prev_system, prev_idle, prev_iowait, prev_irq,
-      prev_softirq;
-  sscanf(line, "cpu %ld %ld %ld %ld %ld %ld %ld", &prev_user, &prev_nice,
-         &prev_system, &prev_idle, &prev_iowait, &prev_irq, &prev_softirq);
+  // Whole seconds are all that is printed
+  const char *cursor = buffer;
+  sample->uptime_seconds = parseUnsigned(&cursor);
+}
 
-  fclose(file);
+// Function to print all system information
+void printSystem(const SystemSample *sample) {
+  const struct utsname *systemData = &sample->uts;
+  screenPrintf("### System Information ###\n");
+  screenPrintf("System Name = %s\n", systemData->sysname);
+  screenPrintf("Machine Name = %s\n", systemData->nodename);
+  screenPrintf("Version = %s\n", systemData->version);
+  screenPrintf("Release = %s\n", systemData->release);
+  screenPrintf("System Name = %s\n", systemData->sysname);
+  screenPrintf("Architecture = %s\n", systemData->machine);
+  printUptime(sample->uptime_seconds);  // Uptime goes with the system data.
+}
 
-  // Sleep for 1 second
-  usleep(6000);
+// Helper function that returns the first line that isn't a cpu line, or NULL
+// if the text ends before one starts.
+static const char *endOfCpuLines(const char *text) {
+  const char *line = text;
+  while (strncmp(line, "cpu", 3) == 0) {
+    line = strchr(line, '\n');
+    if (line == NULL) {
+      return NULL;
+    }
+    line++;
+  }
+  return strnlen(line, 3) == 3 ? line : NULL;
+}
 
-  file = fopen("/proc/stat", "r");
-  if (file == NULL) {
-    perror("Error opening /proc/stat");
-    return -1;
+// Function to sample the counters of the whole system and of every cpu from
+// one read of /proc/stat, returns a malloc'd sample and its size in bytes
+CpuSample *sampleCpu(size_t *size) {
+  static char *text = NULL;
+  static size_t capacity = 0;
+
+  // One pread of /proc/stat. The cpu lines come first, the buffer only
+  // grows until it holds all of them, the long intr line after is cut off.
+  for (;;) {
+    if (capacity == 0) {
+      capacity = 16384;
+      text = malloc(capacity);
+      if (text == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+      }
+    }
+    ssize_t length = readProcFile(&statFile, text, capacity);
+    if (length < (ssize_t)capacity - 1 || endOfCpuLines(text) != NULL) {
+      break;
+    }
+    capacity *= 2;
+    free(text);
+    text = malloc(capacity);
+    if (text == NULL) {
+      perror("malloc");
+      exit(EXIT_FAILURE);
+    }
   }
 
-  fgets(line, sizeof(line), file);
+  // Count the per cpu lines to size the counter rows
+  int num_cpus = 0;
+  const char *end = endOfCpuLines(text);
+  for (const char *line = text; line != NULL && line != end &&
+                                strncmp(line, "cpu", 3) == 0;
+       line = nextLine(line)) {
+    if (line[3] != ' ') {
+      num_cpus++;
+    }
+  }
 
-  long curr_user, curr_nice, curr_system, curr_idle, curr_iowait, curr_irq,
-      curr_softirq;
-  sscanf(line, "cpu %ld %ld %ld %ld %ld %ld %ld", &curr_user, &curr_nice,
-         &curr_system, &curr_idle, &curr_iowait, &curr_irq, &curr_softirq);
+  *size = sizeof(CpuSample) +
+          (num_cpus + 1) * CPU_FIELDS * sizeof(uint64_t) +
+          num_cpus * sizeof(uint32_t);
+  CpuSample *sample = calloc(1, *size);
+  if (sample == NULL) {
+    perror("calloc");
+    exit(EXIT_FAILURE);
+  }
+  // Every online cpu has a line, so sysconf(_SC_NPROCESSORS_ONLN) and the
+  // file it reads aren't needed
+  sample->num_cpus = num_cpus;
+  uint32_t *numbers = (uint32_t *)cpuNumbers(sample, *size);
+
+  // Row 0 is the aggregate cpu line, the next rows the cpuN lines in order.
+  // Older kernels print fewer fields, those stay zero.
+  const char *line = text;
+  for (int row = 0; line != NULL && row <= num_cpus; row++) {
+    const char *p = line + 3;
+    if (row > 0) {
+      numbers[row - 1] = parseUnsigned(&p);
+    }
+    uint64_t *counters = sample->counters + row * CPU_FIELDS;
+    for (int field = 0; field < CPU_FIELDS && *p == ' '; field++) {
+      counters[field] = parseUnsigned(&p);
+    }
+    line = nextLine(line);
+  }
+  return sample;
+}
 
-  fclose(file);
+// Function that returns the N of the cpuN line of every cpu of a sample
+// length bytes long, or NULL when it was recorded before they were kept and
+// cpus are numbered by position.
+const uint32_t *cpuNumbers(const CpuSample *sample, size_t length) {
+  size_t counters = sizeof(CpuSample) + (size_t)(sample->num_cpus + 1) *
+                                            CPU_FIELDS * sizeof(uint64_t);
+  if (length < counters + (size_t)sample->num_cpus * sizeof(uint32_t)) {
+    return NULL;
+  }
+  return (const uint32_t *)((const char *)sample + counters);
+}
 
-  // Calculate total and idle times
-  long prev_total_time = prev_user + prev_nice + prev_system + prev_idle +
-                         prev_iowait + prev_irq + prev_softirq;
-  long curr_total_time = curr_user + curr_nice + curr_system + curr_idle +
-                         curr_iowait + curr_irq + curr_softirq;
-  long prev_idle_time = prev_idle;
-  long curr_idle_time = curr_idle;
+// Function to update cpu usage between the previous counters and the
+// current sample of length bytes, the sample becomes the previous one so the
+// next call covers the next interval.
+void updateCpuUsage(CpuUsage *usage, const CpuSample *sample, size_t length) {
+  int rows = sample->num_cpus + 1;
+  size_t count = (size_t)rows * CPU_FIELDS;
+  int changed = rows != usage->rows;
+  if (rows != usage->rows) {
+    usage->rows = rows;
+    usage->prev = realloc(usage->prev, count * sizeof(uint64_t));
+    usage->delta = realloc(usage->delta, count * sizeof(uint64_t));
+    usage->busy = realloc(usage->busy, rows * sizeof(double));
+    usage->iowait = realloc(usage->iowait, rows * sizeof(double));
+    usage->steal = realloc(usage->steal, rows * sizeof(double));
+    usage->guest = realloc(usage->guest, rows * sizeof(double));
+    usage->cpus = realloc(usage->cpus, rows * sizeof(int));
+    if (usage->prev == NULL || usage->delta == NULL || usage->busy == NULL ||
+        usage->iowait == NULL || usage->steal == NULL || usage->guest == NULL ||
+        usage->cpus == NULL) {
+      perror("realloc");
+      exit(EXIT_FAILURE);
+    }
+  }
+  const uint32_t *numbers = cpuNumbers(sample, length);
+  for (int n = 0; n < rows - 1; n++) {
+    int number = numbers != NULL ? (int)numbers[n] : n;
+    changed |= usage->cpus[n] != number;
+    usage->cpus[n] = number;
+  }
+  usage->sinceBoot = changed;
+  if (changed) {
+    // First sample or cpus went on/offline, measure since boot
+    memset(usage->prev, 0, count * sizeof(uint64_t));
+  }
 
-  // Calculate utilization
-  double utilization = ((double)(curr_total_time - prev_total_time -
-                                 (curr_idle_time - prev_idle_time)) /
-                        (double)(curr_total_time - prev_total_time)) *
-                       100.0;
+  // One pass over every counter of every cpu. Counters that went backwards
+  // (seen on some hypervisors) count as not advanced. Written without
+  // branches so the compiler can vectorize it.
+  uint64_t *restrict prev = usage->prev;
+  uint64_t *restrict delta = usage->delta;
+  const uint64_t *restrict curr = sample->counters;
+  for (size_t i = 0; i < count; i++) {
+    uint64_t d = curr[i] - prev[i];
+    delta[i] = curr[i] >= prev[i] ? d : 0;
+    prev[i] = curr[i];
+  }
 
-  return utilization;
+  for (int row = 0; row < rows; row++) {
+    const uint64_t *d = delta + row * CPU_FIELDS;
+    // Guest time is already included in user and nice
+    uint64_t total = d[CPU_USER] + d[CPU_NICE] + d[CPU_SYSTEM] + d[CPU_IDLE] +
+                     d[CPU_IOWAIT] + d[CPU_IRQ] + d[CPU_SOFTIRQ] + d[CPU_STEAL];
+    double scale = total ? 100.0 / (double)total : 0.00;
+    usage->busy[row] =
+        (double)(total - d[CPU_IDLE] - d[CPU_IOWAIT] - d[CPU_STEAL]) * scale;
+    usage->iowait[row] = (double)d[CPU_IOWAIT] * scale;
+    usage->steal[row] = (double)d[CPU_STEAL] * scale;
+    usage->guest[row] = (double)(d[CPU_GUEST] + d[CPU_GUEST_NICE]) * scale;
+  }
 }
 
 /// Function to print CPU information
-void printCpu() {
-  // Get number of cores using sysconf
-  int num_cores = sysconf(_SC_NPROCESSORS_ONLN);
-  printf("Number of cores: %d\n", num_cores);
-  double cpu_usage =
-      getUsage();  // Get double representing cpu usage percentage
-  printf("total cpu use = %.2f%%\n", cpu_usage);
+void printCpu(const CpuUsage *usage) {
+  screenPrintf("Number of cores: %d\n", usage->rows - 1);
+  screenPrintf(
+      "total cpu use = %.2f%% (iowait %.2f%%, steal %.2f%%, guest %.2f%%)\n",
+      usage->busy[0], usage->iowait[0], usage->steal[0], usage->guest[0]);
 }
 
-/// Function to print CPU information
-void printCpuGraphics() {
-  double cpu_usage =
-      getUsage();  // Get double representing cpu usage percentage
-  printf("\t\t | | |");
-  double counter = cpu_usage;
-  for (int i = 0; counter >= 1; i++) {
-    printf(" |");
-    counter -= 1;
+// Function to print a heatmap of the busy and steal time of every cpu, one
+// character per cpu and CORES_PER_LINE cpus per line
+void printCpuCores(const CpuUsage *usage) {
+  static const char levels[] = " .:-=+*#%@";
+  char busy[CORES_PER_LINE + 1];
+  char steal[CORES_PER_LINE + 1];
+  int num_cpus = usage->rows - 1;
+  for (int first = 0; first < num_cpus; first += CORES_PER_LINE) {
+    int n = num_cpus - first < CORES_PER_LINE ? num_cpus - first
+                                              : CORES_PER_LINE;
+    for (int i = 0; i < n; i++) {
+      int busy_level = (int)(usage->busy[first + i + 1] / 10.0);
+      int steal_level = (int)(usage->steal[first + i + 1] / 10.0);
+      busy[i] = levels[busy_level > 9 ? 9 : busy_level];
+      steal[i] = levels[steal_level > 9 ? 9 : steal_level];
+    }
+    busy[n] = '\0';
+    steal[n] = '\0';
+    screenPrintf(" cpu%3d-%-3d busy  |%s|\n", usage->cpus[first],
+                 usage->cpus[first + n - 1], busy);
+    screenPrintf("           steal |%s|\n", steal);
   }
-  printf(" %.2f\n", cpu_usage);
+}
+
+// Function that returns how many lines printCpuCores prints
+int cpuCoresLines(int num_cpus) {
+  return 2 * ((num_cpus + CORES_PER_LINE - 1) / CORES_PER_LINE);
+}
+
+/// Function to print CPU usage as a bar from 0 to 100%
+void printCpuGraphics(double cpu_usage) {
+  screenPrintf("\t\t |");
+  drawBar(cpu_usage, 100);
+  screenPrintf("| %.2f\n", cpu_usage);
 }
 
 // Function to print samples, seconds and memory usage
-void printRunning(int sample, int sec) {
-  printf("Nbr of samples: %d -- every %d secs\n", sample, sec);
+void printRunning(int sample, int interval_ms) {
+  if (interval_ms % 1000 == 0) {
+    screenPrintf("Nbr of samples: %d -- every %d secs\n", sample,
+                 interval_ms / 1000);
+  } else {
+    screenPrintf("Nbr of samples: %d -- every %d ms\n", sample, interval_ms);
+  }
   // Using sys/resource.h to find memory usage
   struct rusage usage;
   getrusage(RUSAGE_SELF, &usage);
   long memory_usage_kb = usage.ru_maxrss;
-  printf("Memory usage: %lu kilobytes\n", memory_usage_kb);
+  screenPrintf("Memory usage: %lu kilobytes\n", memory_usage_kb);
 }
 
-// Function to print memory information at one snapshot in time
-void printMemory() {
-  // Use sys/sysinfo to get memory ifnormation
-  struct sysinfo mem_info;
-  if (sysinfo(&mem_info) != 0) {
-    perror("Failed to get system information");
-    return;
+// Keys of /proc/meminfo that are kept, indexed by the MEM_ fields
+static const char *const meminfoKeys[MEM_FIELDS] = {
+    [MEM_TOTAL] = "MemTotal",       [MEM_FREE] = "MemFree",
+    [MEM_AVAILABLE] = "MemAvailable", [MEM_BUFFERS] = "Buffers",
+    [MEM_CACHED] = "Cached",         [MEM_SWAP_CACHED] = "SwapCached",
+    [MEM_SWAP_TOTAL] = "SwapTotal",  [MEM_SWAP_FREE] = "SwapFree",
+    [MEM_DIRTY] = "Dirty",           [MEM_WRITEBACK] = "Writeback",
+    [MEM_SHMEM] = "Shmem",           [MEM_SLAB] = "Slab"};
+
+// Open addressing table from the hash of a key to its field, built once so
+// each line of /proc/meminfo costs one hash and at most one memcmp instead
+// of a strcmp against every key.
+#define MEMINFO_SLOTS 64
+static signed char meminfoSlots[MEMINFO_SLOTS];
+
+// Helper function to hash a key of the given length
+static unsigned meminfoHash(const char *key, size_t length) {
+  unsigned hash = 2166136261u;
+  for (size_t i = 0; i < length; i++) {
+    hash = (hash ^ (unsigned char)key[i]) * 16777619u;
+  }
+  return hash;
+}
+
+// Helper function to fill the key table
+static void buildMeminfoSlots() {
+  memset(meminfoSlots, -1, sizeof(meminfoSlots));
+  for (int field = 0; field < MEM_FIELDS; field++) {
+    const char *key = meminfoKeys[field];
+    unsigned slot = meminfoHash(key, strlen(key)) % MEMINFO_SLOTS;
+    while (meminfoSlots[slot] != -1) {
+      slot = (slot + 1) % MEMINFO_SLOTS;
+    }
+    meminfoSlots[slot] = field;
   }
+}
 
-  // Physical memory
-  double phys_used_gb = (double)(mem_info.totalram - mem_info.freeram) *
-                        mem_info.mem_unit / (1024 * 1024 * 1024);
-  double phys_total_gb =
-      (double)mem_info.totalram * mem_info.mem_unit / (1024 * 1024 * 1024);
+// Helper function that returns the field of a key, or -1 when it isn't kept
+static int meminfoField(const char *key, size_t length) {
+  unsigned slot = meminfoHash(key, length) % MEMINFO_SLOTS;
+  while (meminfoSlots[slot] != -1) {
+    const char *candidate = meminfoKeys[(int)meminfoSlots[slot]];
+    if (strncmp(candidate, key, length) == 0 && candidate[length] == '\0') {
+      return meminfoSlots[slot];
+    }
+    slot = (slot + 1) % MEMINFO_SLOTS;
+  }
+  return -1;
+}
 
-  // Virtual memory
-  double virt_used_gb = (double)(mem_info.totalswap - mem_info.freeswap) *
-                        mem_info.mem_unit / (1024 * 1024 * 1024);
-  double virt_total_gb =
-      (double)mem_info.totalswap * mem_info.mem_unit / (1024 * 1024 * 1024);
+// Function to sample memory information at one snapshot in time from one pass
+// over /proc/meminfo, returns -1 on failure
+int sampleMemory(MemorySample *sample) {
+  static int built = 0;
+  if (!built) {
+    buildMeminfoSlots();
+    built = 1;
+  }
 
-  printf("%.2f GB / %.2f GB -- %.2f GB / %.2f GB\n", phys_used_gb,
-         phys_total_gb, virt_used_gb, virt_total_gb);
+  memset(sample, 0, sizeof(*sample));
+  char text[8192];
+  if (readProcFile(&meminfoFile, text, sizeof(text)) <= 0) {
+    return -1;
+  }
+
+  int found = 0;
+  for (const char *line = text; line != NULL && found < MEM_FIELDS;
+       line = nextLine(line)) {
+    const char *colon = strchr(line, ':');
+    if (colon == NULL) {
+      break;
+    }
+    int field = meminfoField(line, colon - line);
+    if (field != -1) {
+      const char *cursor = colon + 1;
+      sample->kb[field] = parseUnsigned(&cursor);
+      found++;
+    }
+  }
+
+  // Kernels before 3.14 don't report MemAvailable, estimate it the way free
+  // did back then
+  if (sample->kb[MEM_AVAILABLE] == 0) {
+    sample->kb[MEM_AVAILABLE] = sample->kb[MEM_FREE] +
+                                sample->kb[MEM_BUFFERS] +
+                                sample->kb[MEM_CACHED];
+  }
+  return 0;
+}
+
+// Helper function to convert kB to GB
+static double kbToGb(uint64_t kb) { return (double)kb / (1024 * 1024); }
+
+// Function that returns the physical memory in use in GB. Page cache and
+// buffers the kernel can reclaim count as available, not used.
+double physUsedGb(const MemorySample *sample) {
+  uint64_t total = sample->kb[MEM_TOTAL];
+  uint64_t available = sample->kb[MEM_AVAILABLE];
+  return kbToGb(total > available ? total - available : 0);
+}
+
+// Helper function that returns the swap in use in GB
+static double virtUsedGb(const MemorySample *sample) {
+  uint64_t total = sample->kb[MEM_SWAP_TOTAL];
+  uint64_t free = sample->kb[MEM_SWAP_FREE];
+  return kbToGb(total > free ? total - free : 0);
 }
 
 // Function to print memory information at one snapshot in time
-double printMemoryGraphical(double prev_phys) {
-  // Use sys/sysinfo to get memory ifnormation
-  struct sysinfo mem_info;
-  if (sysinfo(&mem_info) != 0) {
-    perror("Failed to get system information");
-    return 0.00;
-  }
-
-  // Physical memory
-  double phys_used_gb = (double)(mem_info.totalram - mem_info.freeram) *
-                        mem_info.mem_unit / (1024 * 1024 * 1024);
-  double phys_total_gb =
-      (double)mem_info.totalram * mem_info.mem_unit / (1024 * 1024 * 1024);
-
-  // Virtual memory
-  double virt_used_gb = (double)(mem_info.totalswap - mem_info.freeswap) *
-                        mem_info.mem_unit / (1024 * 1024 * 1024);
-  double virt_total_gb =
-      (double)mem_info.totalswap * mem_info.mem_unit / (1024 * 1024 * 1024);
-
-  printf("%.2f GB / %.2f GB -- %.2f GB / %.2f GB", phys_used_gb, phys_total_gb,
-         virt_used_gb, virt_total_gb);
-  printf("\t|");
+void printMemory(const MemorySample *sample) {
+  screenPrintf("%.2f GB / %.2f GB -- %.2f GB / %.2f GB\n", physUsedGb(sample),
+               kbToGb(sample->kb[MEM_TOTAL]), virtUsedGb(sample),
+               kbToGb(sample->kb[MEM_SWAP_TOTAL]));
+}
+
+// Function to print memory information at one snapshot in time along with
+// the growth since prev_phys, as a bar where all of the memory fills
+// CHART_WIDTH columns
+double printMemoryGraphical(const MemorySample *sample, double prev_phys) {
+  double phys_used_gb = physUsedGb(sample);
+  screenPrintf("%.2f GB / %.2f GB -- %.2f GB / %.2f GB", phys_used_gb,
+               kbToGb(sample->kb[MEM_TOTAL]), virtUsedGb(sample),
+               kbToGb(sample->kb[MEM_SWAP_TOTAL]));
+  screenPrintf("\t|");
   if (prev_phys == 0) {
-    printf("o 0.00 (%.2f)", phys_used_gb);
+    screenPrintf("o 0.00 (%.2f)", phys_used_gb);
   } else {
     double diff = phys_used_gb - prev_phys;
     if (diff < 0) {
       diff = 0.00;
     }
-    double count = diff;
-    for (int i = 0; count > 0.00; i++) {
-      printf("#");
-      count -= 0.01;
-    }
-    printf("* %.2f (%.2f)\n", diff, phys_used_gb);
+    drawBarFill(diff, kbToGb(sample->kb[MEM_TOTAL]));
+    screenPrintf("* %.2f (%.2f)\n", diff, phys_used_gb);
   }
   return phys_used_gb;
 }
 
 // Function to print users with a new line added for every user
-void printUsers() {
-  // Use utmp.h to get user information
-  struct utmp *utmp_entry;
-
-  setutent();  // Set the file position to the beginning of the utmp file
-
-  int users = 0;
-  int sessions = 0;
-
-  while ((utmp_entry = getutent()) != NULL) {
-    if (utmp_entry->ut_type == USER_PROCESS) {
-      // Print User information
-      printf(" %-10s %s (%s)\n", utmp_entry->ut_user, utmp_entry->ut_line,
-             utmp_entry->ut_host);
-      users++;
-      sessions++;
-    } else if (utmp_entry->ut_type == LOGIN_PROCESS) {
-      sessions++;
-    }
+void printUsers(const UsersSample *sample) {
+  for (uint32_t i = 0; i < sample->count; i++) {
+    // Print User information
+    screenPrintf(" %-10s %s (%s)\n", sample->users[i].user,
+                 sample->users[i].line, sample->users[i].host);
   }
-
-  endutent();  // Close the utmp file
-}
\ No newline at end of file
+}
@@ -1,12 +1,108 @@
 #ifndef FUNCTIONS_H
 #define FUNCTIONS_H
 
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/utsname.h>
+#include <utmp.h>
+
+// Fields of /proc/meminfo kept in a memory sample, in kB
+enum {
+  MEM_TOTAL,
+  MEM_FREE,
+  MEM_AVAILABLE,
+  MEM_BUFFERS,
+  MEM_CACHED,
+  MEM_SWAP_CACHED,
+  MEM_SWAP_TOTAL,
+  MEM_SWAP_FREE,
+  MEM_DIRTY,
+  MEM_WRITEBACK,
+  MEM_SHMEM,
+  MEM_SLAB,
+  MEM_FIELDS
+};
+
+// Memory counters from /proc/meminfo at one snapshot in time
+typedef struct {
+  uint64_t kb[MEM_FIELDS];
+} MemorySample;
+
+// One logged in user, strings are always null terminated
+typedef struct {
+  char user[UT_NAMESIZE + 1];
+  char line[UT_LINESIZE + 1];
+  char host[UT_HOSTSIZE + 1];
+} UserEntry;
+
+// Logged in users, count entries follow the count
+typedef struct {
+  uint32_t count;
+  UserEntry users[];
+} UsersSample;
+
+// Fields of a cpu line in /proc/stat, in clock ticks
+enum {
+  CPU_USER,
+  CPU_NICE,
+  CPU_SYSTEM,
+  CPU_IDLE,
+  CPU_IOWAIT,
+  CPU_IRQ,
+  CPU_SOFTIRQ,
+  CPU_STEAL,
+  CPU_GUEST,
+  CPU_GUEST_NICE,
+  CPU_FIELDS
+};
+
+// Cpus shown per line of the per core heatmap
+#define CORES_PER_LINE 64
+
+// Raw cpu counters at one snapshot in time, (num_cpus + 1) rows of CPU_FIELDS
+// counters follow, row 0 is the whole system and the others one cpu each.
+// After them comes the N of the cpuN line of every cpu, as offline cpus
+// leave gaps. Usage is computed by whoever holds the previous snapshot.
+typedef struct {
+  int32_t reserved;  // Zero, older samples repeat num_cpus
+  int32_t num_cpus;
+  uint64_t counters[];
+} CpuSample;
+
+// Cpu usage over the last interval in percent, one entry per counter row
+typedef struct {
+  int rows;
+  int sinceBoot;    // Set when there was no previous sample to measure from
+  uint64_t *prev;   // Counters of the previous sample
+  uint64_t *delta;  // Counters advanced during the interval
+  double *busy;
+  double *iowait;
+  double *steal;
+  double *guest;
+  int *cpus;  // N of the cpuN of every row after the first
+} CpuUsage;
+
+// System information and the uptime at the time it was sampled
+typedef struct {
+  struct utsname uts;
+  uint64_t uptime_seconds;
+} SystemSample;
+
 // Function prototypes
-void printMemory();
-void printUsers();
-void printCpu();
-void printRunning(int sample, int second);
-void printSystem();
-double printMemoryGraphical(double prev_phys);
-void printCpuGraphics();
+void openProcFiles();
+int sampleMemory(MemorySample *sample);
+double physUsedGb(const MemorySample *sample);
+void printMemory(const MemorySample *sample);
+double printMemoryGraphical(const MemorySample *sample, double prev_phys);
+void printUsers(const UsersSample *sample);
+CpuSample *sampleCpu(size_t *size);
+const uint32_t *cpuNumbers(const CpuSample *sample, size_t length);
+void updateCpuUsage(CpuUsage *usage, const CpuSample *sample, size_t length);
+void printCpu(const CpuUsage *usage);
+void printCpuCores(const CpuUsage *usage);
+int cpuCoresLines(int num_cpus);
+void printCpuGraphics(double cpu_usage);
+void printRunning(int sample, int interval_ms);
+void sampleSystem(SystemSample *sample);
+void printSystem(const SystemSample *sample);
 #endif  // FUNCTIONS_H
\ No newline at end of file
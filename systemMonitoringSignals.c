@@ -1,5 +1,7 @@
 #include <errno.h>
+#include <limits.h>
 #include <signal.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -12,9 +14,30 @@
 #include <unistd.h>
 #include <utmp.h>
 
-#define READ_END 0
-#define WRITE_END 1
+#define STALE_COLUMN 60
+#define DEFAULT_DEADLINE_MS 500
+#define INTERVAL_ONCE -1
+#define SYSTEM_LINES 8
+#define DEFAULT_HISTORY_MB 4
+#define SPARKLINE_LINES 1  // Cpu history line shown in graphics mode
+#include "chart.h"
+#include "collectors.h"
+#include "format.h"
+#include "history.h"
+#include "merge.h"
+#include "processes.h"
+#include "publish.h"
+#include "query.h"
+#include "recording.h"
+#include "rollup.h"
+#include "scheduler.h"
+#include "screen.h"
+#include "server.h"
+#include "sessions.h"
 #include "stats_functions.h"
+#include "viewers.h"
+
+static int coreLines = 0;  // Lines of the per core heatmap, 0 when hidden
 
 // Custom signal handler for SIGINT (Ctrl + C)
 void sigint_handler() {
@@ -82,1227 +105,1240 @@ int extractPositiveInteger(const char *str) {
 
   return result;
 }
-// Function to count the number of current users
-int countUsers() {
-  // Use utmp.h to count the users.
-  struct utmp *utmp_entry;
-
-  setutent();  // Set the file position to the beginning of the utmp file
-
-  int users = 0;
 
-  while ((utmp_entry = getutent()) != NULL) {
-    if (utmp_entry->ut_type == USER_PROCESS) {
-      users++;
-    }
+// Function to extract an interval in milliseconds from a flag, used in
+// cases of tdelay. A plain number is in seconds, "ms" and "s" suffixes pick
+// the unit, e.g. --tdelay=250ms or --tdelay=1.5s. Exits when the value
+// isn't a whole number of milliseconds above zero, a zero interval would
+// spin the timer.
+int extractInterval(const char *str) {
+  const char *value = strchr(str, '=');
+  value = value != NULL ? value + 1 : str;
+  char *unit;
+  errno = 0;
+  double number = strtod(value, &unit);
+  double scale = 0;  // Unknown units make the interval invalid
+  if (*unit == '\0' || strcmp(unit, "s") == 0) {
+    scale = 1000;
+  } else if (strcmp(unit, "ms") == 0) {
+    scale = 1;
   }
-
-  endutent();  // Close the utmp file
-
-  return users;
-}
-
-// Function to print non-sampled sections when all appear.
-void printConstant(int sample, int seconds, int graphics) {
-  printRunning(sample, seconds);
-  printf("---------------------------------------\n");
-  printf("### Memory ### (Phys.Used/Tot -- Virtual Used/Tot)\n");
-  for (int i = 0; i < sample; i++) {
-    printf("\n");
-  }
-  printf("---------------------------------------\n");
-  printf("### Sessions/users ###\n");
-  int n = countUsers();
-  for (int i = 0; i < n; i++) {
-    printf("\n");
-  }
-  printf("---------------------------------------\n");
-  printf("\n");
-  printf("\n");
-  if (graphics) {
-    for (int i = 0; i < sample; i++) {
-      printf("\n");
-    }
+  double ms = number * scale;
+  if (errno != 0 || unit == value || scale == 0 || !(ms >= 1) ||
+      ms > INT_MAX || ms != (int)ms) {
+    fprintf(stderr,
+            "Invalid interval %s, use seconds or a ms or s suffix, "
+            "e.g. 250ms\n",
+            str);
+    exit(EXIT_FAILURE);
   }
-  printf("---------------------------------------\n");
-  printSystem();
-  printf("---------------------------------------\n");
+  return ms;
 }
 
-// Helper function that returns used physical memory to compare for graphics.
-double firstMemorySample() {
-  // Use sys/sysinfo to get memory ifnormation
-  struct sysinfo mem_info;
-  if (sysinfo(&mem_info) != 0) {
-    perror("Failed to get system information");
-    return -1;
-  }
+// Options picked on the command line
+typedef struct {
+  int sample;
+  int intervalMs;
+  int graphics;
+  int system;
+  int user;
+  int sequential;
+  int persistent;
+  int deadlineMs;
+  int cores;
+  int cost;
+  int historyMb;           // Memory cap of the sample history
+  const char *recordPath;  // File every record is appended to, or NULL
+  int compress;            // Delta encode the recording
+  const char *replayPath;  // Recording rendered instead of /proc, or NULL
+  int speed;               // Replay speed up, 0 renders as fast as possible
+  int format;              // FORMAT_SCREEN or a headless format
+  const char *serveAddress;  // Metrics endpoint of a live run, or NULL
+  const char *publishName;   // Shared memory snapshot of a live run, or NULL
+  const char *daemonPath;    // Socket viewers of a live run attach to, or NULL
+  const char *attachPath;    // Daemon rendered instead of /proc, or NULL
+  int top;                   // Processes listed per ranking, 0 for none
+} Options;
+
+// Logged in users, shared with the collector children
+static SessionCache sessions;
+
+// Functions run inside the collector children, each sends one record.
+void runMemoryCollector(int tick) {
+  MemorySample sample;
+  sampleMemory(&sample);
+  sendRecord(RECORD_MEMORY, tick, &sample, sizeof(sample));
+}
 
-  // Physical memory
-  double phys_used_gb = (double)(mem_info.totalram - mem_info.freeram) *
-                        mem_info.mem_unit / (1024 * 1024 * 1024);
-  return phys_used_gb;
+void runUsersCollector(int tick) {
+  refreshSessions(&sessions);
+  sendRecord(RECORD_USERS, tick, sessions.users, sessions.size);
 }
 
-// Function to print when no flags are present or system and user are present,
-// accounts for graphics as well.
-void printAllInformation(int sample, int seconds, int graphics) {
-  if (graphics == 0) {
-    printConstant(sample, seconds, graphics);
-
-    for (int i = 0; i < sample; ++i) {
-      int memoryPipe[2], usersPipe[2], cpuPipe[2];
-      if (pipe(memoryPipe) == -1) {
-        perror("pipe");
-        exit(EXIT_FAILURE);
-      }
-      if (pipe(usersPipe) == -1) {
-        perror("pipe");
-        exit(EXIT_FAILURE);
-      }
+void runCpuCollector(int tick) {
+  size_t size;
+  CpuSample *sample = sampleCpu(&size);
+  sendRecord(RECORD_CPU, tick, sample, size);
+  free(sample);
+}
 
-      if (pipe(cpuPipe) == -1) {
-        perror("pipe");
-        exit(EXIT_FAILURE);
-      }
+// Process scanner of the processes collector, it keeps every process's cpu
+// time between samples in the persistent child
+static ProcessScanner processScanner;
 
-      pid_t memoryPid, usersPid, cpuPid;
-      memoryPid = fork();
-      if (memoryPid == -1) {
-        perror("fork");
-        exit(EXIT_FAILURE);
-      } else if (memoryPid == 0) {  // Child process
-        close(memoryPipe[0]);       // Close unused read end of the pipe
-        dup2(memoryPipe[1],
-             STDOUT_FILENO);   // Redirect stdout to the write end of the pipe
-        close(memoryPipe[1]);  // Close the write end of the pipe in the child
-        printMemory();         // Execute the function in the child process
-        exit(EXIT_SUCCESS);
-      }
+void runProcessesCollector(int tick) {
+  size_t size;
+  ProcessSample *sample = scanProcesses(&processScanner, &size);
+  sendRecord(RECORD_PROCESSES, tick, sample, size);
+  free(sample);
+}
 
-      usersPid = fork();
-      if (usersPid == -1) {
-        perror("fork");
-        exit(EXIT_FAILURE);
-      } else if (usersPid == 0) {
-        close(usersPipe[0]);  // Close unused read end of the pipe
-        dup2(usersPipe[1],
-             STDOUT_FILENO);  // Redirect stdout to the write end of the pipe
-        close(usersPipe[1]);  // Close the write end of the pipe in the child
-        printUsers();         // Execute the function in the child process
-        exit(EXIT_SUCCESS);
-      }
-      // Close unnecessary pipe ends in the parent process
-
-      cpuPid = fork();
-      if (cpuPid == -1) {
-        perror("fork");
-        exit(EXIT_FAILURE);
-      } else if (cpuPid == 0) {
-        close(cpuPipe[0]);  // Close unused read end of the pipe
-        dup2(cpuPipe[1],
-             STDOUT_FILENO);  // Redirect stdout to the write end of the pipe
-        close(cpuPipe[1]);    // Close the write end of the pipe in the child
-        printCpu();           // Execute the function in the child process
-        exit(EXIT_SUCCESS);
-      }
-      // Close unnecessary pipe ends in the parent process
-
-      close(usersPipe[1]);
-      close(memoryPipe[1]);
-      close(cpuPipe[1]);
-
-      char buffer[1024];
-      char buffer1[1024];
-      char buffer2[1024];
-      ssize_t nbytes1, nbytes2, nbytes3;
-
-      while ((nbytes1 = read(memoryPipe[0], buffer, sizeof(buffer))) > 0) {
-        // Print the data using printf
-        printf("\033[1;1H\033[%d;0H%.*s", 5 + i, (int)nbytes1,
-               buffer);  // Move cursor to the top left corner and then to
-                         // the 17 + i rows down and the first column, then
-                         // print the content
-      }
+void runSystemCollector(int tick) {
+  SystemSample sample;
+  sampleSystem(&sample);
+  sendRecord(RECORD_SYSTEM, tick, &sample, sizeof(sample));
+}
 
-      while ((nbytes2 = read(usersPipe[0], buffer1, sizeof(buffer1))) > 0) {
-        // Print the data using printf
-        printf("\033[1;1H\033[%d;0H%.*s", 7 + sample, (int)nbytes2,
-               buffer1);  // Move cursor to the top left corner and then to
-                          // the 17 + i rows down and the first column, then
-                          // print the content
-      }
+// One section of the screen and the collector that fills it. The entries are
+// listed in screen order and a single loop triggers each one when it is due,
+// so slow changing sections cost nothing on the ticks in between.
+typedef struct {
+  const char *name;  // Also names the --<name>-interval= flag
+  uint32_t type;     // Record type the collector sends
+  CollectorFunction function;
+  const char *header;  // Printed above the section, NULL for none
+  int intervalMs;      // 0 follows tdelay, INTERVAL_ONCE samples once
+  int stateful;        // Keeps state between samples, so always persistent
+  int enabled;
+  int row;      // First row of the section
+  int lines;    // Rows reserved for the section
+  int samples;  // Records rendered so far
+  int drawn;    // Set when a record was rendered during the current tick
+  const RecordHeader *last;  // Last record rendered, valid while not busy
+  long nextDueMs;
+  Collector collector;
+} RegistryEntry;
+
+static RegistryEntry registry[] = {
+    {.name = "memory",
+     .type = RECORD_MEMORY,
+     .function = runMemoryCollector,
+     .header = "### Memory ### (Phys.Used/Tot -- Virtual Used/Tot)"},
+    {.name = "users",
+     .type = RECORD_USERS,
+     .function = runUsersCollector,
+     .header = "### Sessions/users ###"},
+    {.name = "cpu", .type = RECORD_CPU, .function = runCpuCollector},
+    {.name = "processes",
+     .type = RECORD_PROCESSES,
+     .function = runProcessesCollector,
+     .header = "### Processes ### (top cpu -- top memory)",
+     .stateful = 1},
+    {.name = "system",
+     .type = RECORD_SYSTEM,
+     .function = runSystemCollector,
+     .intervalMs = INTERVAL_ONCE},
+};
+#define REGISTRY_SIZE ((int)(sizeof(registry) / sizeof(registry[0])))
+
+static Scheduler scheduler;
+static int graphicsMode = 0;
+static int outputFormat = FORMAT_SCREEN;
+static int daemonMode = 0;  // Samples go to viewers, nothing is drawn
+static int liveScreen = 0;  // Records go out as they land, not per frame
+
+// Usage since the last cpu sample, starting from zero counters makes the
+// first usage the average since boot instead of sleeping for a baseline.
+static CpuUsage cpuUsage;
+
+// Columns of the cpu history, one busy column per core follows
+enum {
+  CPU_HISTORY_BUSY,
+  CPU_HISTORY_IOWAIT,
+  CPU_HISTORY_STEAL,
+  CPU_HISTORY_GUEST,
+  CPU_HISTORY_CORES
+};
+
+// Every memory and cpu sample of the run, as far as the memory cap allows.
+// Both rings keep the same number of samples, the cpu ring is sized once the
+// number of cores is known from the first sample.
+static HistoryRing memoryHistory, cpuHistory;
+static size_t historyBudget;
+
+// Recording of every record when --record is given, unmapped otherwise,
+// with its rollups kept in FILE.rollup
+static Recording recording;
+static Rollups rollups;
+
+// Prometheus endpoint when --serve is given
+static Server server;
+
+// Latest values of every collector, published to shared memory once per tick
+// when --publish is given
+static Snapshot latest;
+static SharedSnapshot *published;
+
+// Viewers attached to a daemon, every tick's records are sent to them
+static Viewers viewers;
+
+// Frames rendered by a replay and the time it took
+static long replayFrames = 0;
+static double replaySeconds = 0;
+
+// Helper function that returns the registry entry owning a collector.
+static RegistryEntry *registryEntry(Collector *collector) {
+  return (RegistryEntry *)((char *)collector -
+                           offsetof(RegistryEntry, collector));
+}
 
-      int users = countUsers();
-      while ((nbytes3 = read(cpuPipe[0], buffer2, sizeof(buffer2))) > 0) {
-        // Print the data using printf
-        printf("\033[1;1H\033[%d;0H%.*s", users + 8 + sample, (int)nbytes3,
-               buffer2);  // Move cursor to the top left corner and then to
-                          // the 17 + i rows down and the first column, then
-                          // print the content
-      }
+// Helper function that returns the greatest common divisor of two intervals.
+static int gcd(int a, int b) {
+  while (b != 0) {
+    int r = a % b;
+    a = b;
+    b = r;
+  }
+  return a;
+}
 
-      close(memoryPipe[0]);
-      close(usersPipe[0]);
-      close(cpuPipe[0]);
-      sleep(seconds);  // Wait for 1 second before sampling again
+// Function that returns how many records a collector sends over the whole
+// run, which is how many rows it needs when each one gets its own row.
+int recordsOver(const RegistryEntry *entry, const Options *options) {
+  if (entry->intervalMs == INTERVAL_ONCE) {
+    return 1;
+  }
+  if (entry->intervalMs == 0) {
+    return options->sample;
+  }
+  long runMs = (long)options->sample * options->intervalMs;
+  return (runMs + entry->intervalMs - 1) / entry->intervalMs;
+}
 
-      wait(NULL);
-      wait(NULL);
-      wait(NULL);
+// Function to walk the sections of the screen, setting the first row of each
+// enabled entry, and drawing the scaffolding around them when print is set.
+// Returns the rows the screen takes.
+int layoutScreen(const Options *options, int print) {
+  if (print) {
+    moveCursor(1, 1);
+    printRunning(options->sample, options->intervalMs);
+    screenPrintf("---------------------------------------\n");
+  }
+  int row = 4;  // Below the running information and its separator
+  for (int i = 0; i < REGISTRY_SIZE; i++) {
+    RegistryEntry *entry = &registry[i];
+    if (!entry->enabled) {
+      continue;
     }
-    printf("\033[999B");
-    return;
-  } else {
-    printConstant(sample, seconds, 1);
-    double first = firstMemorySample();
-    for (int i = 0; i < sample; ++i) {
-      int memoryPipe[2], usersPipe[2], cpuPipe[2], cpuGraphicalPipe[2];
-      if (pipe(memoryPipe) == -1) {
-        perror("pipe");
-        exit(EXIT_FAILURE);
-      }
-      if (pipe(usersPipe) == -1) {
-        perror("pipe");
-        exit(EXIT_FAILURE);
+    if (entry->header != NULL) {
+      if (print) {
+        screenPrintf("%s\n", entry->header);
       }
-
-      if (pipe(cpuPipe) == -1) {
-        perror("pipe");
-        exit(EXIT_FAILURE);
-      }
-
-      if (pipe(cpuGraphicalPipe) == -1) {
-        perror("pipe");
-        exit(EXIT_FAILURE);
-      }
-
-      pid_t memoryPid, usersPid, cpuPid, cpuGraphPid;
-      memoryPid = fork();
-      if (memoryPid == -1) {
-        perror("fork");
-        exit(EXIT_FAILURE);
-      } else if (memoryPid == 0) {  // Child process
-        close(memoryPipe[0]);       // Close unused read end of the pipe
-        dup2(memoryPipe[1],
-             STDOUT_FILENO);   // Redirect stdout to the write end of the pipe
-        close(memoryPipe[1]);  // Close the write end of the pipe in the child
-
-        if (i == 0) {
-          printMemoryGraphical(0.00);
-        } else {
-          printMemoryGraphical(first);
-        }
-        exit(EXIT_SUCCESS);
-      }
-
-      usersPid = fork();
-      if (usersPid == -1) {
-        perror("fork");
-        exit(EXIT_FAILURE);
-      } else if (usersPid == 0) {
-        close(usersPipe[0]);  // Close unused read end of the pipe
-        dup2(usersPipe[1],
-             STDOUT_FILENO);  // Redirect stdout to the write end of the pipe
-        close(usersPipe[1]);  // Close the write end of the pipe in the child
-        printUsers();         // Execute the function in the child process
-        exit(EXIT_SUCCESS);
-      }
-      // Close unnecessary pipe ends in the parent process
-
-      cpuPid = fork();
-      if (cpuPid == -1) {
-        perror("fork");
-        exit(EXIT_FAILURE);
-      } else if (cpuPid == 0) {
-        close(cpuPipe[0]);  // Close unused read end of the pipe
-        dup2(cpuPipe[1],
-             STDOUT_FILENO);  // Redirect stdout to the write end of the pipe
-        close(cpuPipe[1]);    // Close the write end of the pipe in the child
-        printCpu();           // Execute the function in the child process
-        exit(EXIT_SUCCESS);
-      }
-
-      cpuGraphPid = fork();
-      if (cpuGraphPid == -1) {
-        perror("fork");
-        exit(EXIT_FAILURE);
-      } else if (cpuGraphPid == 0) {
-        close(cpuGraphicalPipe[0]);  // Close unused read end of the pipe
-        dup2(cpuGraphicalPipe[1],
-             STDOUT_FILENO);  // Redirect stdout to the write end of the pipe
-        close(cpuGraphicalPipe[1]);  // Close the write end of the pipe in the
-                                     // child
-        printCpuGraphics();  // Execute the function in the child process
-        exit(EXIT_SUCCESS);
-      }
-      // Close unnecessary pipe ends in the parent process
-
-      close(usersPipe[1]);
-      close(memoryPipe[1]);
-      close(cpuPipe[1]);
-      close(cpuGraphicalPipe[1]);
-
-      char buffer[1024];
-      char buffer1[1024];
-      char buffer2[1024];
-      char buffer3[1024];
-      ssize_t nbytes1, nbytes2, nbytes3, nbytes4;
-
-      while ((nbytes1 = read(memoryPipe[0], buffer, sizeof(buffer))) > 0) {
-        // Print the data using printf
-        printf("\033[1;1H\033[%d;0H%.*s", 5 + i, (int)nbytes1,
-               buffer);  // Move cursor to the top left corner and then to
-                         // the 17 + i rows down and the first column, then
-                         // print the content
-      }
-
-      while ((nbytes2 = read(usersPipe[0], buffer1, sizeof(buffer1))) > 0) {
-        // Print the data using printf
-        printf("\033[1;1H\033[%d;0H%.*s", 7 + sample, (int)nbytes2,
-               buffer1);  // Move cursor to the top left corner and then to
-                          // the 17 + i rows down and the first column, then
-                          // print the content
-      }
-
-      int users = countUsers();
-      while ((nbytes3 = read(cpuPipe[0], buffer2, sizeof(buffer2))) > 0) {
-        // Print the data using printf
-        printf("\033[1;1H\033[%d;0H%.*s", users + 8 + sample, (int)nbytes3,
-               buffer2);  // Move cursor to the top left corner and then to
-                          // the 17 + i rows down and the first column, then
-                          // print the content
-      }
-
-      while ((nbytes4 = read(cpuGraphicalPipe[0], buffer3, sizeof(buffer3))) >
-             0) {
-        // Print the data using printf
-        printf("\033[1;1H\033[%d;0H%.*s", users + 10 + sample + i, (int)nbytes4,
-               buffer3);  // Move cursor to the top left corner and then to
-                          // the 17 + i rows down and the first column, then
-                          // print the content
+      row++;
+    }
+    entry->row = row;
+    row += entry->lines + 1;
+    if (print) {
+      for (int n = 0; n < entry->lines; n++) {
+        screenPrintf("\n");
       }
-
-      close(memoryPipe[0]);
-      close(usersPipe[0]);
-      close(cpuPipe[0]);
-      close(cpuGraphicalPipe[0]);
-      sleep(seconds);  // Wait for 1 second before sampling again
-
-      wait(NULL);
-      wait(NULL);
-      wait(NULL);
-      wait(NULL);
+      screenPrintf("---------------------------------------\n");
     }
-    printf("\033[999B");
-    return;
   }
+  return row - 1;
 }
 
-// Print the things that stay constant
-void printUserConstant(int sample, int seconds) {
-  printRunning(sample, seconds);
-  printf("---------------------------------------\n");
-  printf("### Sessions/users ###\n");
-  int n = countUsers();
-  for (int i = 0; i < n; i++) {
-    printf("\n");
-  }
-  printf("---------------------------------------\n");
-  printSystem();
-  printf("---------------------------------------\n");
+// Helper function that returns the size of the records a collector sends.
+static size_t recordBytes(const RegistryEntry *entry) {
+  switch (entry->type) {
+    case RECORD_MEMORY:
+      return sizeof(RecordHeader) + sizeof(MemorySample);
+    case RECORD_USERS:
+      return sizeof(RecordHeader) + sessions.size;
+    case RECORD_CPU:
+      return sizeof(RecordHeader) + sizeof(CpuSample) +
+             (sysconf(_SC_NPROCESSORS_CONF) + 1) * CPU_FIELDS *
+                 sizeof(uint64_t) +
+             sysconf(_SC_NPROCESSORS_CONF) * sizeof(uint32_t);
+    case RECORD_PROCESSES:
+      return sizeof(RecordHeader) + sizeof(ProcessSample) +
+             PROCESS_RANKINGS * processScanner.top * sizeof(ProcessEntry);
+    default:
+      return sizeof(RecordHeader) + sizeof(SystemSample);
+  }
 }
 
-// Print user information when only user is present.
-void printUserInformation(int sample, int seconds) {
-  printUserConstant(sample, seconds);
-  for (int i = 0; i < sample; ++i) {
-    int usersPipe[2];
-    if (pipe(usersPipe) == -1) {
-      perror("pipe");
-      exit(EXIT_FAILURE);
+// Function to create the recording file. Slots fit one memory or cpu record,
+// the records sent every tick, and the file starts with room for every
+// record the run should produce.
+void startRecordingFile(const Options *options) {
+  RecordingHeader layout = {.sample = options->sample,
+                            .intervalMs = options->intervalMs};
+  size_t slotSize = 0;
+  for (int i = 0; i < REGISTRY_SIZE; i++) {
+    const RegistryEntry *entry = &registry[i];
+    if (entry->enabled && entry->type != RECORD_USERS &&
+        entry->type != RECORD_SYSTEM && recordBytes(entry) > slotSize) {
+      slotSize = recordBytes(entry);
     }
+  }
+  layout.slotSize = (slotSize + 63) / 64 * 64;
+  if (options->compress) {
+    layout.codec = RECORDING_DELTA;
+    layout.slotSize = 1;
+  }
 
-    pid_t usersPid;
-    usersPid = fork();
-    if (usersPid == -1) {
-      perror("fork");
-      exit(EXIT_FAILURE);
-    } else if (usersPid == 0) {
-      close(usersPipe[0]);  // Close unused read end of the pipe
-      dup2(usersPipe[1],
-           STDOUT_FILENO);  // Redirect stdout to the write end of the pipe
-      close(usersPipe[1]);  // Close the write end of the pipe in the child
-      printUsers();         // Execute the function in the child process
-      exit(EXIT_SUCCESS);
+  uint64_t slots = 0;
+  for (int i = 0; i < REGISTRY_SIZE; i++) {
+    const RegistryEntry *entry = &registry[i];
+    if (!entry->enabled) {
+      continue;
     }
-    // Close unnecessary pipe ends in the parent process
+    layout.types |= 1u << entry->type;
+    layout.intervalsMs[entry->type] = entry->intervalMs;
+    slots += (uint64_t)recordsOver(entry, options) *
+             ((recordBytes(entry) + layout.slotSize - 1) / layout.slotSize);
+  }
+  if (options->compress) {
+    slots /= 4;  // A guess at the ratio, the file grows if it is too low
+  }
+  startRecording(&recording, options->recordPath, &layout, slots);
 
-    close(usersPipe[1]);
+  char path[PATH_MAX];
+  snprintf(path, sizeof(path), "%s.rollup", options->recordPath);
+  createRollups(&rollups, path);
+}
 
-    char buffer1[1024];
+// Function to allocate the history, the cap is split so memory and cpu keep
+// as many samples. Every possible cpu is counted as the ones online are only
+// known from the first sample.
+void initHistories(const Options *options, int cpus) {
+  historyBudget = (size_t)options->historyMb * 1024 * 1024;
+  initHistory(&memoryHistory, MEM_FIELDS,
+              historyCapacity(MEM_FIELDS + CPU_HISTORY_CORES + cpus,
+                              historyBudget));
+}
 
-    ssize_t nbytes2;
+// Function that returns the rows an entry's section needs.
+int sectionLines(const RegistryEntry *entry, const Options *options,
+                 int users) {
+  int records = recordsOver(entry, options);
+  switch (entry->type) {
+    case RECORD_MEMORY:
+      return records;
+    case RECORD_USERS:
+      return users;
+    case RECORD_CPU:
+      return 2 + coreLines +
+             (options->graphics ? SPARKLINE_LINES + records : 0);
+    case RECORD_PROCESSES:
+      return 2 + options->top;  // Scan summary and column names first
+    default:
+      return SYSTEM_LINES;
+  }
+}
 
-    while ((nbytes2 = read(usersPipe[0], buffer1, sizeof(buffer1))) > 0) {
-      // Print the data using printf
-      printf("\033[1;1H\033[%d;0H%.*s", 5, (int)nbytes2, buffer1);
+// Start the collectors needed for the selected sections, forking them right
+// away when persistent, and lay out the rows every section needs.
+void startCollectors(const Options *options) {
+  int showSystem = options->system == 1 || options->user == 0;
+  int showUsers = options->user == 1 || options->system == 0;
+  graphicsMode = options->graphics;
+  outputFormat = options->format;
+  daemonMode = options->daemonPath != NULL;
+  openProcFiles();
+  initSessions(&sessions, _PATH_UTMP);
+  refreshSessions(&sessions);  // Forked children start from this snapshot
+  coreLines =
+      options->cores ? cpuCoresLines(sysconf(_SC_NPROCESSORS_ONLN)) : 0;
+
+  initHistories(options, sysconf(_SC_NPROCESSORS_CONF));
+
+  for (int i = 0; i < REGISTRY_SIZE; i++) {
+    RegistryEntry *entry = &registry[i];
+    entry->enabled = 1;
+    if (entry->intervalMs != INTERVAL_ONCE &&
+        (entry->intervalMs == 0 || options->intervalMs == 0)) {
+      entry->intervalMs = options->intervalMs;
     }
 
-    close(usersPipe[0]);
+    // A collector can't be waited for longer than one of its intervals.
+    int deadlineMs = options->deadlineMs;
+    int periodMs =
+        entry->intervalMs > 0 ? entry->intervalMs : options->intervalMs;
+    if (periodMs > 0 && deadlineMs > periodMs) {
+      deadlineMs = periodMs;
+    }
 
-    sleep(seconds);  // Wait for 1 second before sampling again
-    wait(NULL);
+    if (entry->type == RECORD_MEMORY || entry->type == RECORD_CPU) {
+      entry->enabled = showSystem;
+    } else if (entry->type == RECORD_USERS) {
+      entry->enabled = showUsers;
+    } else if (entry->type == RECORD_PROCESSES) {
+      entry->enabled = options->top > 0;
+      if (entry->enabled) {
+        initProcessScanner(&processScanner, options->top);
+      }
+    }
+    // The sessions section is sized by the users records received, what the
+    // parent reads from utmp drifts from what a persistent child sends
+    entry->lines = sectionLines(entry, options, 0);
+    if (entry->enabled) {
+      // A collector sampling once has nothing to keep a child around for
+      startCollector(&entry->collector, entry->function,
+                     (options->persistent || entry->stateful) &&
+                         entry->intervalMs != INTERVAL_ONCE,
+                     deadlineMs);
+    }
   }
-  printf("\033[999B");
-  return;
-}
-
-// Print user when sequential is called (no for loop)
-void printUserSeq(int sample, int seconds) {
-  printUserConstant(sample, seconds);
-  int usersPipe[2];
-  if (pipe(usersPipe) == -1) {
-    perror("pipe");
-    exit(EXIT_FAILURE);
+  initScreen(layoutScreen(options, 0));
+  if (options->recordPath != NULL) {
+    startRecordingFile(options);
   }
+}
 
-  pid_t usersPid;
-  usersPid = fork();
-  if (usersPid == -1) {
-    perror("fork");
-    exit(EXIT_FAILURE);
-  } else if (usersPid == 0) {
-    close(usersPipe[0]);  // Close unused read end of the pipe
-    dup2(usersPipe[1],
-         STDOUT_FILENO);  // Redirect stdout to the write end of the pipe
-    close(usersPipe[1]);  // Close the write end of the pipe in the child
-    printUsers();         // Execute the function in the child process
-    exit(EXIT_SUCCESS);
+// Stop every collector child.
+void stopCollectors() {
+  for (int i = 0; i < REGISTRY_SIZE; i++) {
+    if (registry[i].enabled) {
+      stopCollector(&registry[i].collector);
+    }
   }
-  // Close unnecessary pipe ends in the parent process
-
-  close(usersPipe[1]);
-
-  char buffer1[1024];
-
-  ssize_t nbytes2;
+  stopRecording(&recording);
+}
 
-  while ((nbytes2 = read(usersPipe[0], buffer1, sizeof(buffer1))) > 0) {
-    // Print the data using printf
-    printf("\033[1;1H\033[%d;0H%.*s", 5, (int)nbytes2, buffer1);
+// Function that returns the row of an entry's index-th record, sections with
+// a row per record fill them top down.
+int recordRow(const RegistryEntry *entry, int index) {
+  if (entry->type != RECORD_MEMORY) {
+    return entry->row;
   }
-
-  close(usersPipe[0]);
-
-  sleep(seconds);  // Wait for 1 second before sampling again
-  wait(NULL);
-
-  printf("\033[999B");
-  return;
+  return entry->row + (index < entry->lines ? index : entry->lines - 1);
 }
 
-// Print just system information for when system is called.
-void printSystemInformation(int sample, int seconds, int graphics) {
-  if (graphics == 0) {
-    printRunning(sample, seconds);
-    printf("---------------------------------------\n");
-    printf("### Memory ### (Phys.Used/Tot -- Virtual Used/Tot)\n");
-    for (int i = 0; i < sample; i++) {
-      printf("\n");
+// Function to add a record to the history of its metric.
+void recordHistory(const RecordHeader *record) {
+  if (record->type == RECORD_MEMORY) {
+    double row[MEM_FIELDS];
+    const MemorySample *sample = (const MemorySample *)(record + 1);
+    for (int f = 0; f < MEM_FIELDS; f++) {
+      row[f] = sample->kb[f];
     }
-    printf("---------------------------------------\n");
-    printf("\n");
-    printf("\n");
-    printf("---------------------------------------\n");
-    printSystem();
-    printf("---------------------------------------\n");
-
-    for (int i = 0; i < sample; ++i) {
-      int memoryPipe[2], cpuPipe[2];
-      if (pipe(memoryPipe) == -1) {
-        perror("pipe");
-        exit(EXIT_FAILURE);
-      }
-
-      if (pipe(cpuPipe) == -1) {
-        perror("pipe");
-        exit(EXIT_FAILURE);
-      }
-
-      pid_t memoryPid, cpuPid;
-      memoryPid = fork();
-      if (memoryPid == -1) {
-        perror("fork");
-        exit(EXIT_FAILURE);
-      } else if (memoryPid == 0) {  // Child process
-        close(memoryPipe[0]);       // Close unused read end of the pipe
-        dup2(memoryPipe[1],
-             STDOUT_FILENO);   // Redirect stdout to the write end of the pipe
-        close(memoryPipe[1]);  // Close the write end of the pipe in the child
-        printMemory();         // Execute the function in the child process
-        exit(EXIT_SUCCESS);
-      }
-
-      cpuPid = fork();
-      if (cpuPid == -1) {
-        perror("fork");
-        exit(EXIT_FAILURE);
-      } else if (cpuPid == 0) {
-        close(cpuPipe[0]);  // Close unused read end of the pipe
-        dup2(cpuPipe[1],
-             STDOUT_FILENO);  // Redirect stdout to the write end of the pipe
-        close(cpuPipe[1]);    // Close the write end of the pipe in the child
-        printCpu();           // Execute the function in the child process
-        exit(EXIT_SUCCESS);
-      }
-      // Close unnecessary pipe ends in the parent process
-
-      close(memoryPipe[1]);
-      close(cpuPipe[1]);
-
-      char buffer[1024];
-
-      char buffer2[1024];
-      ssize_t nbytes1, nbytes3;
-
-      while ((nbytes1 = read(memoryPipe[0], buffer, sizeof(buffer))) > 0) {
-        // Print the data using printf
-        printf("\033[1;1H\033[%d;0H%.*s", 5 + i, (int)nbytes1,
-               buffer);  // Move cursor to the top left corner and then to
-                         // the 17 + i rows down and the first column, then
-                         // print the content
-      }
-
-      while ((nbytes3 = read(cpuPipe[0], buffer2, sizeof(buffer2))) > 0) {
-        // Print the data using printf
-        printf("\033[1;1H\033[%d;0H%.*s", 6 + sample, (int)nbytes3,
-               buffer2);  // Move cursor to the top left corner and then to
-                          // the 17 + i rows down and the first column, then
-                          // print the content
-      }
-
-      close(memoryPipe[0]);
-
-      close(cpuPipe[0]);
-      sleep(seconds);  // Wait for 1 second before sampling again
-
-      wait(NULL);
-      wait(NULL);
+    appendHistory(&memoryHistory, record->timestamp_ns, row);
+  } else if (record->type == RECORD_CPU && !cpuUsage.sinceBoot) {
+    // The since-boot average isn't a sample of any interval
+    int columns = CPU_HISTORY_CORES + cpuUsage.rows - 1;
+    if (cpuHistory.values == NULL) {
+      size_t used = historyBytes(&memoryHistory);
+      size_t left = historyBudget > used ? historyBudget - used : 0;
+      size_t capacity = historyCapacity(columns, left);
+      initHistory(&cpuHistory, columns,
+                  capacity < memoryHistory.capacity ? capacity
+                                                    : memoryHistory.capacity);
     }
-    printf("\033[999B");
-    return;
-  } else {
-    printRunning(sample, seconds);
-    printf("---------------------------------------\n");
-    printf("### Memory ### (Phys.Used/Tot -- Virtual Used/Tot)\n");
-    for (int i = 0; i < sample; i++) {
-      printf("\n");
+    if (columns != cpuHistory.columns) {
+      return;  // A cpu went online or offline, keep the layout of the ring
     }
-    printf("---------------------------------------\n");
-    printf("\n");
-    printf("\n");
-    for (int i = 0; i < sample; i++) {
-      printf("\n");
+    double values[columns];
+    values[CPU_HISTORY_BUSY] = cpuUsage.busy[0];
+    values[CPU_HISTORY_IOWAIT] = cpuUsage.iowait[0];
+    values[CPU_HISTORY_STEAL] = cpuUsage.steal[0];
+    values[CPU_HISTORY_GUEST] = cpuUsage.guest[0];
+    for (int n = 1; n < cpuUsage.rows; n++) {
+      values[CPU_HISTORY_CORES + n - 1] = cpuUsage.busy[n];
     }
-    printf("---------------------------------------\n");
-    printSystem();
-    printf("---------------------------------------\n");
-    double first = firstMemorySample();
-    for (int i = 0; i < sample; ++i) {
-      int memoryPipe[2], cpuPipe[2], cpuGraphicalPipe[2];
-      if (pipe(memoryPipe) == -1) {
-        perror("pipe");
-        exit(EXIT_FAILURE);
-      }
-
-      if (pipe(cpuPipe) == -1) {
-        perror("pipe");
-        exit(EXIT_FAILURE);
-      }
+    appendHistory(&cpuHistory, record->timestamp_ns, values);
+  }
+}
 
-      if (pipe(cpuGraphicalPipe) == -1) {
-        perror("pipe");
-        exit(EXIT_FAILURE);
-      }
+// Function to fold the metrics of a record into the rollups of the recording.
+void rollupRecord(const RecordHeader *record) {
+  int64_t ts = record->timestamp_ns;
+  if (record->type == RECORD_MEMORY) {
+    const MemorySample *sample = (const MemorySample *)(record + 1);
+    addRollup(&rollups, ROLLUP_MEMORY_USED, ts,
+              (double)sample->kb[MEM_TOTAL] - sample->kb[MEM_AVAILABLE]);
+    addRollup(&rollups, ROLLUP_SWAP_USED, ts,
+              (double)sample->kb[MEM_SWAP_TOTAL] - sample->kb[MEM_SWAP_FREE]);
+  } else if (record->type == RECORD_CPU && !cpuUsage.sinceBoot) {
+    // Like a query, the first cpu record only sets up what follows
+    addRollup(&rollups, ROLLUP_CPU_BUSY, ts, cpuUsage.busy[0]);
+    addRollup(&rollups, ROLLUP_CPU_IOWAIT, ts, cpuUsage.iowait[0]);
+    addRollup(&rollups, ROLLUP_CPU_STEAL, ts, cpuUsage.steal[0]);
+  } else if (record->type == RECORD_USERS) {
+    addRollup(&rollups, ROLLUP_USERS, ts,
+              ((const UsersSample *)(record + 1))->count);
+  }
+}
 
-      pid_t memoryPid, cpuPid, cpuGraphPid;
-      memoryPid = fork();
-      if (memoryPid == -1) {
-        perror("fork");
-        exit(EXIT_FAILURE);
-      } else if (memoryPid == 0) {  // Child process
-        close(memoryPipe[0]);       // Close unused read end of the pipe
-        dup2(memoryPipe[1],
-             STDOUT_FILENO);   // Redirect stdout to the write end of the pipe
-        close(memoryPipe[1]);  // Close the write end of the pipe in the child
-
-        if (i == 0) {
-          printMemoryGraphical(0.00);
-        } else {
-          printMemoryGraphical(first);
-        }
-        exit(EXIT_SUCCESS);
-      }
+// Helper function that returns the used physical memory of the oldest sample
+// in the history, the graph shows the change since then.
+double oldestPhysUsed() {
+  MemorySample sample;
+  if (memoryHistory.count == 0) {
+    return 0.00;
+  }
+  for (int f = 0; f < MEM_FIELDS; f++) {
+    sample.kb[f] = historyValue(&memoryHistory, f, 0);
+  }
+  return physUsedGb(&sample);
+}
 
-      cpuPid = fork();
-      if (cpuPid == -1) {
-        perror("fork");
-        exit(EXIT_FAILURE);
-      } else if (cpuPid == 0) {
-        close(cpuPipe[0]);  // Close unused read end of the pipe
-        dup2(cpuPipe[1],
-             STDOUT_FILENO);  // Redirect stdout to the write end of the pipe
-        close(cpuPipe[1]);    // Close the write end of the pipe in the child
-        printCpu();           // Execute the function in the child process
-        exit(EXIT_SUCCESS);
+// Draw a record at its row, index is the number of records of the same
+// collector rendered before it.
+void drawRecord(const RegistryEntry *entry, const RecordHeader *record,
+                int index) {
+  // Move cursor to the record's row and the first column, then draw the
+  // content
+  moveCursor(recordRow(entry, index), 1);
+  const void *payload = record + 1;
+  switch (record->type) {
+    case RECORD_MEMORY:
+      if (!graphicsMode) {
+        printMemory(payload);
+      } else if (index == 0) {
+        printMemoryGraphical(payload, 0.00);
+      } else {
+        printMemoryGraphical(payload, oldestPhysUsed());
       }
-
-      cpuGraphPid = fork();
-      if (cpuGraphPid == -1) {
-        perror("fork");
-        exit(EXIT_FAILURE);
-      } else if (cpuGraphPid == 0) {
-        close(cpuGraphicalPipe[0]);  // Close unused read end of the pipe
-        dup2(cpuGraphicalPipe[1],
-             STDOUT_FILENO);  // Redirect stdout to the write end of the pipe
-        close(cpuGraphicalPipe[1]);  // Close the write end of the pipe in the
-                                     // child
-        printCpuGraphics();  // Execute the function in the child process
-        exit(EXIT_SUCCESS);
+      break;
+    case RECORD_USERS:
+      // Users that logged out leave rows behind
+      for (int n = 0; n < entry->lines; n++) {
+        moveCursor(entry->row + n, 1);
+        clearToEnd();
       }
-      // Close unnecessary pipe ends in the parent process
-
-      close(memoryPipe[1]);
-      close(cpuPipe[1]);
-      close(cpuGraphicalPipe[1]);
-
-      char buffer[1024];
-
-      char buffer2[1024];
-      char buffer3[1024];
-      ssize_t nbytes1, nbytes3, nbytes4;
-
-      while ((nbytes1 = read(memoryPipe[0], buffer, sizeof(buffer))) > 0) {
-        // Print the data using printf
-        printf("\033[1;1H\033[%d;0H%.*s", 5 + i, (int)nbytes1,
-               buffer);  // Move cursor to the top left corner and then to
-                         // the 17 + i rows down and the first column, then
-                         // print the content
+      moveCursor(entry->row, 1);
+      printUsers(payload);
+      break;
+    case RECORD_CPU:
+      // One /proc/stat read feeds the text, per core and graphical views
+      printCpu(&cpuUsage);
+      if (graphicsMode) {
+        screenPrintf(" busy history    |");
+        drawSparkline(&cpuHistory, CPU_HISTORY_BUSY, 100);
+        screenPrintf("|\n");
       }
-
-      while ((nbytes3 = read(cpuPipe[0], buffer2, sizeof(buffer2))) > 0) {
-        // Print the data using printf
-        printf("\033[1;1H\033[%d;0H%.*s", 6 + sample, (int)nbytes3,
-               buffer2);  // Move cursor to the top left corner and then to
-                          // the 17 + i rows down and the first column, then
-                          // print the content
+      if (coreLines) {
+        printCpuCores(&cpuUsage);
       }
-
-      while ((nbytes4 = read(cpuGraphicalPipe[0], buffer3, sizeof(buffer3))) >
-             0) {
-        // Print the data using printf
-        printf("\033[1;1H\033[%d;0H%.*s", 8 + sample + i, (int)nbytes4,
-               buffer3);  // Move cursor to the top left corner and then to
-                          // the 17 + i rows down and the first column, then
-                          // print the content
+      if (graphicsMode) {
+        int graphRow = entry->row + 2 + SPARKLINE_LINES + coreLines;
+        int graphRows = entry->lines - 2 - SPARKLINE_LINES - coreLines;
+        moveCursor(graphRow + (index < graphRows ? index : graphRows - 1), 1);
+        printCpuGraphics(cpuUsage.busy[0]);
       }
-
-      close(memoryPipe[0]);
-
-      close(cpuPipe[0]);
-      close(cpuGraphicalPipe[0]);
-      sleep(seconds);  // Wait for 1 second before sampling again
-
-      wait(NULL);
-
-      wait(NULL);
-      wait(NULL);
-    }
-    printf("\033[999B");
-    return;
+      break;
+    case RECORD_PROCESSES:
+      printProcesses(payload);
+      break;
+    case RECORD_SYSTEM:
+      printSystem(payload);
+      break;
   }
 }
 
-// Print system for when sequential is called and only system
-void printSystemSeq(int sample, int seconds, int graphics, int i) {
-  if (graphics == 0) {
-    printRunning(sample, seconds);
-    printf("---------------------------------------\n");
-    printf("### Memory ### (Phys.Used/Tot -- Virtual Used/Tot)\n");
-    for (int i = 0; i < sample; i++) {
-      printf("\n");
-    }
-    printf("---------------------------------------\n");
-    printf("\n");
-    printf("\n");
-    printf("---------------------------------------\n");
-    printSystem();
-    printf("---------------------------------------\n");
-
-    int memoryPipe[2], cpuPipe[2];
-    if (pipe(memoryPipe) == -1) {
-      perror("pipe");
-      exit(EXIT_FAILURE);
-    }
-
-    if (pipe(cpuPipe) == -1) {
-      perror("pipe");
-      exit(EXIT_FAILURE);
-    }
-
-    pid_t memoryPid, cpuPid;
-    memoryPid = fork();
-    if (memoryPid == -1) {
-      perror("fork");
-      exit(EXIT_FAILURE);
-    } else if (memoryPid == 0) {  // Child process
-      close(memoryPipe[0]);       // Close unused read end of the pipe
-      dup2(memoryPipe[1],
-           STDOUT_FILENO);   // Redirect stdout to the write end of the pipe
-      close(memoryPipe[1]);  // Close the write end of the pipe in the child
-      printMemory();         // Execute the function in the child process
-      exit(EXIT_SUCCESS);
+// Function to give an entry's section more rows when its records need them,
+// the sections below move down. The sessions section starts empty and grows
+// to the most users its records list, a daemon's viewers grow theirs from
+// the same records and new viewers get the size in the hello.
+void growSection(RegistryEntry *entry, int lines) {
+  if (lines <= entry->lines) {
+    return;
+  }
+  int added = lines - entry->lines;
+  int below = entry->row + entry->lines;  // The section's separator
+  entry->lines = lines;
+  for (int i = 0; i < REGISTRY_SIZE; i++) {
+    if (registry[i].row > entry->row) {
+      registry[i].row += added;
     }
-
-    cpuPid = fork();
-    if (cpuPid == -1) {
-      perror("fork");
-      exit(EXIT_FAILURE);
-    } else if (cpuPid == 0) {
-      close(cpuPipe[0]);  // Close unused read end of the pipe
-      dup2(cpuPipe[1],
-           STDOUT_FILENO);  // Redirect stdout to the write end of the pipe
-      close(cpuPipe[1]);    // Close the write end of the pipe in the child
-      printCpu();           // Execute the function in the child process
-      exit(EXIT_SUCCESS);
+    if (registry[i].collector.row >= below) {
+      registry[i].collector.row += added;
     }
-    // Close unnecessary pipe ends in the parent process
-
-    close(memoryPipe[1]);
-    close(cpuPipe[1]);
-
-    char buffer[1024];
-
-    char buffer2[1024];
-    ssize_t nbytes1, nbytes3;
+  }
+  if (daemonMode) {
+    viewers.hello.users = lines;
+  } else if (outputFormat == FORMAT_SCREEN) {
+    insertRows(below, added);
+  }
+}
 
-    while ((nbytes1 = read(memoryPipe[0], buffer, sizeof(buffer))) > 0) {
-      // Print the data using printf
-      printf("\033[1;1H\033[%d;0H%.*s", 5 + i, (int)nbytes1,
-             buffer);  // Move cursor to the top left corner and then to
-                       // the 17 + i rows down and the first column, then
-                       // print the content
+// Decode a collector's record and draw it at the collector's row, or mark
+// the row stale when the collector missed its deadline. A live run sends
+// what changed as each record lands, a replay's frame goes out once its
+// records are drawn. Headless formats take the record's fields instead,
+// and a daemon passes the record on to its viewers.
+void renderCollector(Collector *collector, const RecordHeader *record) {
+  RegistryEntry *entry = registryEntry(collector);
+  int headless = outputFormat != FORMAT_SCREEN || daemonMode;
+  if (record == NULL) {
+    if (headless) {
+      return;
     }
-
-    while ((nbytes3 = read(cpuPipe[0], buffer2, sizeof(buffer2))) > 0) {
-      // Print the data using printf
-      printf("\033[1;1H\033[%d;0H%.*s", 6 + sample, (int)nbytes3,
-             buffer2);  // Move cursor to the top left corner and then to
-                        // the 17 + i rows down and the first column, then
-                        // print the content
+    moveCursor(collector->row, STALE_COLUMN);
+    screenPrintf("[stale]");
+    if (liveScreen) {
+      flushScreen();
     }
-
-    close(memoryPipe[0]);
-
-    close(cpuPipe[0]);
-    sleep(seconds);  // Wait for 1 second before sampling again
-
-    wait(NULL);
-    wait(NULL);
-
-    printf("\033[999B");
     return;
+  }
+  if (collector->stale && !headless) {
+    moveCursor(collector->row, STALE_COLUMN);
+    clearToEnd();
+  }
+  if (record->type == RECORD_CPU) {
+    updateCpuUsage(&cpuUsage, (const CpuSample *)(record + 1),
+                   record->length);
+  } else if (record->type == RECORD_USERS) {
+    growSection(entry, ((const UsersSample *)(record + 1))->count);
+  }
+  recordHistory(record);  // Before drawing, the sparkline shows the record
+  formatRecord(record, &cpuUsage);  // Latest values of lines and metrics
+  updateSnapshot(&latest, record, &cpuUsage);
+  if (daemonMode) {
+    addViewerRecord(&viewers, record);
+  }
+  if (headless) {
+    entry->samples++;
   } else {
-    printRunning(sample, seconds);
-    printf("---------------------------------------\n");
-    printf("### Memory ### (Phys.Used/Tot -- Virtual Used/Tot)\n");
-    for (int i = 0; i < sample; i++) {
-      printf("\n");
-    }
-    printf("---------------------------------------\n");
-    printf("\n");
-    printf("\n");
-    for (int i = 0; i < sample; i++) {
-      printf("\n");
-    }
-    printf("---------------------------------------\n");
-    printSystem();
-    printf("---------------------------------------\n");
-    double first = firstMemorySample();
-
-    int memoryPipe[2], cpuPipe[2], cpuGraphicalPipe[2];
-    if (pipe(memoryPipe) == -1) {
-      perror("pipe");
-      exit(EXIT_FAILURE);
-    }
-
-    if (pipe(cpuPipe) == -1) {
-      perror("pipe");
-      exit(EXIT_FAILURE);
-    }
-
-    if (pipe(cpuGraphicalPipe) == -1) {
-      perror("pipe");
-      exit(EXIT_FAILURE);
-    }
-
-    pid_t memoryPid, cpuPid, cpuGraphPid;
-    memoryPid = fork();
-    if (memoryPid == -1) {
-      perror("fork");
-      exit(EXIT_FAILURE);
-    } else if (memoryPid == 0) {  // Child process
-      close(memoryPipe[0]);       // Close unused read end of the pipe
-      dup2(memoryPipe[1],
-           STDOUT_FILENO);   // Redirect stdout to the write end of the pipe
-      close(memoryPipe[1]);  // Close the write end of the pipe in the child
-
-      if (i == 0) {
-        printMemoryGraphical(0.00);
-      } else {
-        printMemoryGraphical(first);
-      }
-      exit(EXIT_SUCCESS);
-    }
+    drawRecord(entry, record, entry->samples++);
+  }
+  entry->last = record;
+  if (recording.map != NULL) {
+    appendRecording(&recording, record);
+    rollupRecord(record);
+  }
+  entry->drawn = 1;
+  if (liveScreen) {
+    flushScreen();  // A slow collector doesn't hold back the others
+  }
+}
 
-    cpuPid = fork();
-    if (cpuPid == -1) {
-      perror("fork");
-      exit(EXIT_FAILURE);
-    } else if (cpuPid == 0) {
-      close(cpuPipe[0]);  // Close unused read end of the pipe
-      dup2(cpuPipe[1],
-           STDOUT_FILENO);  // Redirect stdout to the write end of the pipe
-      close(cpuPipe[1]);    // Close the write end of the pipe in the child
-      printCpu();           // Execute the function in the child process
-      exit(EXIT_SUCCESS);
+// Trigger every collector due at nowMs and render the records as they come.
+void collectDue(int tick, long nowMs) {
+  Collector *collectors[REGISTRY_SIZE];
+  int count = 0;
+
+  beginCollectorTick();
+  for (int i = 0; i < REGISTRY_SIZE; i++) {
+    RegistryEntry *entry = &registry[i];
+    entry->drawn = 0;
+    if (!entry->enabled || nowMs < entry->nextDueMs) {
+      continue;
     }
-
-    cpuGraphPid = fork();
-    if (cpuGraphPid == -1) {
-      perror("fork");
-      exit(EXIT_FAILURE);
-    } else if (cpuGraphPid == 0) {
-      close(cpuGraphicalPipe[0]);  // Close unused read end of the pipe
-      dup2(cpuGraphicalPipe[1],
-           STDOUT_FILENO);  // Redirect stdout to the write end of the pipe
-      close(cpuGraphicalPipe[1]);  // Close the write end of the pipe in the
-                                   // child
-      printCpuGraphics();          // Execute the function in the child process
-      exit(EXIT_SUCCESS);
+    entry->nextDueMs = entry->intervalMs == INTERVAL_ONCE
+                           ? LONG_MAX
+                           : entry->nextDueMs + entry->intervalMs;
+    if (entry->type == RECORD_USERS && !entry->collector.persistent) {
+      // A child forked per sample can't update the cache it inherits, so
+      // the parent keeps it current and the child finds nothing to parse
+      refreshSessions(&sessions);
     }
-    // Close unnecessary pipe ends in the parent process
-
-    close(memoryPipe[1]);
-    close(cpuPipe[1]);
-    close(cpuGraphicalPipe[1]);
-
-    char buffer[1024];
-
-    char buffer2[1024];
-    char buffer3[1024];
-    ssize_t nbytes1, nbytes3, nbytes4;
-
-    while ((nbytes1 = read(memoryPipe[0], buffer, sizeof(buffer))) > 0) {
-      // Print the data using printf
-      printf("\033[1;1H\033[%d;0H%.*s", 5 + i, (int)nbytes1,
-             buffer);  // Move cursor to the top left corner and then to
-                       // the 17 + i rows down and the first column, then
-                       // print the content
+    if (triggerCollector(&entry->collector, tick)) {
+      entry->collector.row = recordRow(entry, entry->samples);
     }
+    collectors[count++] = &entry->collector;
+  }
+  pollCollectors(collectors, count, renderCollector);
+  endCollectorTick();
+}
 
-    while ((nbytes3 = read(cpuPipe[0], buffer2, sizeof(buffer2))) > 0) {
-      // Print the data using printf
-      printf("\033[1;1H\033[%d;0H%.*s", 6 + sample, (int)nbytes3,
-             buffer2);  // Move cursor to the top left corner and then to
-                        // the 17 + i rows down and the first column, then
-                        // print the content
+// Reprint the last record of every entry that wasn't rendered this tick, used
+// when the whole screen is printed again every tick.
+void redrawIdle() {
+  for (int i = 0; i < REGISTRY_SIZE; i++) {
+    RegistryEntry *entry = &registry[i];
+    if (entry->enabled && !entry->drawn && !entry->collector.busy &&
+        entry->samples > 0) {
+      drawRecord(entry, entry->last, entry->samples - 1);
     }
+  }
+}
 
-    while ((nbytes4 = read(cpuGraphicalPipe[0], buffer3, sizeof(buffer3))) >
-           0) {
-      // Print the data using printf
-      printf("\033[1;1H\033[%d;0H%.*s", 8 + sample + i, (int)nbytes4,
-             buffer3);  // Move cursor to the top left corner and then to
-                        // the 17 + i rows down and the first column, then
-                        // print the content
+// Function to describe the sections of a daemon to its viewers, the way a
+// recording header describes them to a replay.
+void daemonHello(const Options *options, ViewerHello *hello) {
+  memset(hello, 0, sizeof(*hello));
+  hello->sample = options->sample;
+  hello->intervalMs = options->intervalMs;
+  hello->cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  hello->top = options->top;
+  for (int i = 0; i < REGISTRY_SIZE; i++) {
+    const RegistryEntry *entry = &registry[i];
+    if (!entry->enabled) {
+      continue;
     }
-
-    close(memoryPipe[0]);
-
-    close(cpuPipe[0]);
-    close(cpuGraphicalPipe[0]);
-    sleep(seconds);  // Wait for 1 second before sampling again
-
-    wait(NULL);
-
-    wait(NULL);
-    wait(NULL);
-
-    printf("\033[999B");
-    return;
+    hello->types |= 1u << entry->type;
+    hello->intervalsMs[entry->type] = entry->intervalMs;
   }
 }
 
-// Print everything when sequential is called and appropriate condition.
-void printAllSeq(int sample, int seconds, int graphics, int i) {
-  if (graphics == 0) {
-    printConstant(sample, seconds, graphics);
-    int memoryPipe[2], usersPipe[2], cpuPipe[2];
-    if (pipe(memoryPipe) == -1) {
-      perror("pipe");
-      exit(EXIT_FAILURE);
+// Function to run the monitor. The scheduler ticks at the greatest common
+// divisor of all intervals, and every tick only the collectors that are due
+// are sampled. Each record is drawn into the screen model as it lands and
+// what changed is sent in one write, so a slow collector only delays its
+// own section. In sequential mode the whole screen is sent again on every
+// tick instead. Headless formats write one line per tick and no screen. The
+// metrics endpoint is served while waiting for ticks and updated after each,
+// like the shared memory snapshot. A daemon draws nothing either, it takes
+// in viewers while waiting and sends each of them every tick's records.
+void runMonitor(const Options *options) {
+  startCollectors(options);
+  int baseMs = options->intervalMs;
+  for (int i = 0; i < REGISTRY_SIZE; i++) {
+    if (registry[i].enabled && registry[i].intervalMs > 0) {
+      baseMs = gcd(baseMs, registry[i].intervalMs);
     }
-    if (pipe(usersPipe) == -1) {
-      perror("pipe");
-      exit(EXIT_FAILURE);
+  }
+  long ticks = baseMs > 0 ? (long)options->sample * options->intervalMs / baseMs
+                          : options->sample;
+  startScheduler(&scheduler, baseMs);
+  if (options->serveAddress != NULL) {
+    startServer(&server, options->serveAddress);
+    watchScheduler(&scheduler, server.epollFd, serveScrapes, &server);
+  }
+  if (options->publishName != NULL) {
+    published = createSnapshot(options->publishName);
+  }
+  if (daemonMode) {
+    ViewerHello hello;
+    daemonHello(options, &hello);
+    startViewers(&viewers, options->daemonPath, &hello);
+    watchScheduler(&scheduler, viewers.listenFd, acceptViewers, &viewers);
+  }
+  int headless = options->format != FORMAT_SCREEN || daemonMode;
+  liveScreen = !headless;
+  if (!options->sequential && !headless) {
+    layoutScreen(options, 1);
+    flushScreen();
+  }
+  for (long tick = 0; tick < ticks; tick++) {
+    waitScheduler(&scheduler);  // Wait until the tick is due
+    if (options->sequential && !headless) {
+      repaintScreen();
+      layoutScreen(options, 1);
     }
-
-    if (pipe(cpuPipe) == -1) {
-      perror("pipe");
-      exit(EXIT_FAILURE);
+    collectDue(tick, tick * baseMs);
+    if (options->serveAddress != NULL) {
+      updateServer(&server);
     }
-
-    pid_t memoryPid, usersPid, cpuPid;
-    memoryPid = fork();
-    if (memoryPid == -1) {
-      perror("fork");
-      exit(EXIT_FAILURE);
-    } else if (memoryPid == 0) {  // Child process
-      close(memoryPipe[0]);       // Close unused read end of the pipe
-      dup2(memoryPipe[1],
-           STDOUT_FILENO);   // Redirect stdout to the write end of the pipe
-      close(memoryPipe[1]);  // Close the write end of the pipe in the child
-      printMemory();         // Execute the function in the child process
-      exit(EXIT_SUCCESS);
+    if (published != NULL) {
+      publishSnapshot(published, &latest);
     }
-
-    usersPid = fork();
-    if (usersPid == -1) {
-      perror("fork");
-      exit(EXIT_FAILURE);
-    } else if (usersPid == 0) {
-      close(usersPipe[0]);  // Close unused read end of the pipe
-      dup2(usersPipe[1],
-           STDOUT_FILENO);  // Redirect stdout to the write end of the pipe
-      close(usersPipe[1]);  // Close the write end of the pipe in the child
-      printUsers();         // Execute the function in the child process
-      exit(EXIT_SUCCESS);
+    if (daemonMode) {
+      sendViewerFrame(&viewers);
     }
-    // Close unnecessary pipe ends in the parent process
-
-    cpuPid = fork();
-    if (cpuPid == -1) {
-      perror("fork");
-      exit(EXIT_FAILURE);
-    } else if (cpuPid == 0) {
-      close(cpuPipe[0]);  // Close unused read end of the pipe
-      dup2(cpuPipe[1],
-           STDOUT_FILENO);  // Redirect stdout to the write end of the pipe
-      close(cpuPipe[1]);    // Close the write end of the pipe in the child
-      printCpu();           // Execute the function in the child process
-      exit(EXIT_SUCCESS);
+    if (headless) {
+      if (options->format != FORMAT_SCREEN) {
+        formatTick(tick);
+        flushFormat();
+      }
+      continue;
     }
-    // Close unnecessary pipe ends in the parent process
-
-    close(usersPipe[1]);
-    close(memoryPipe[1]);
-    close(cpuPipe[1]);
-
-    char buffer[1024];
-    char buffer1[1024];
-    char buffer2[1024];
-    ssize_t nbytes1, nbytes2, nbytes3;
-
-    while ((nbytes1 = read(memoryPipe[0], buffer, sizeof(buffer))) > 0) {
-      // Print the data using printf
-      printf("\033[%d;0H%.*s", 5 + i, (int)nbytes1,
-             buffer);  // Move cursor to the top left corner and then to
-                       // the 17 + i rows down and the first column, then
-                       // print the content
-    }
-
-    while ((nbytes2 = read(usersPipe[0], buffer1, sizeof(buffer1))) > 0) {
-      // Print the data using printf
-      printf("\033[%d;0H%.*s", sample + 7, (int)nbytes2,
-             buffer1);  // Move cursor to the top left corner and then to
-                        // the 17 + i rows down and the first column, then
-                        // print the content
+    if (options->sequential) {
+      redrawIdle();
     }
+    flushScreen();
+  }
+  if (!headless) {
+    printf("\033[999B");
+  }
+  if (options->serveAddress != NULL) {
+    stopServer(&server);
+  }
+  if (published != NULL) {
+    removeSnapshot(published, options->publishName);
+  }
+  if (daemonMode) {
+    stopViewers(&viewers);
+  }
+  stopCollectors();
+  stopScheduler(&scheduler);
+}
 
-    while ((nbytes3 = read(cpuPipe[0], buffer2, sizeof(buffer2))) > 0) {
-      // Print the data using printf
-      printf("\033[%d;0H%.*s", sample + 14, (int)nbytes3,
-             buffer2);  // Move cursor to the top left corner and then to
-                        // the 17 + i rows down and the first column, then
-                        // print the content
+// Helper function that returns the enabled entry rendering a record type.
+static RegistryEntry *entryForType(uint32_t type) {
+  for (int i = 0; i < REGISTRY_SIZE; i++) {
+    if (registry[i].enabled && registry[i].type == type) {
+      return &registry[i];
     }
-    close(memoryPipe[0]);
-    close(usersPipe[0]);
-    close(cpuPipe[0]);
+  }
+  return NULL;
+}
 
-    wait(NULL);
-    wait(NULL);
-    wait(NULL);
+// Function to enable the sections of the record types a recording or a
+// daemon holds and lay them out, the most users seen and the number of cpus
+// size their sections.
+void layoutSections(const Options *options, uint32_t types,
+                    const int32_t *intervalsMs, int users, int cpus) {
+  coreLines = options->cores ? cpuCoresLines(cpus) : 0;
+  initHistories(options, cpus);
+  for (int i = 0; i < REGISTRY_SIZE; i++) {
+    RegistryEntry *entry = &registry[i];
+    entry->enabled = (types >> entry->type) & 1;
+    entry->intervalMs = intervalsMs[entry->type];
+    entry->lines = sectionLines(entry, options, users);
+  }
+  initScreen(layoutScreen(options, 0));
+  if (!options->sequential && options->format == FORMAT_SCREEN) {
+    layoutScreen(options, 1);
+    flushScreen();
+  }
+}
 
-    printf("\033[100B");
-    return;
-  } else {
-    printConstant(sample, seconds, 1);
-    double first = firstMemorySample();
+// Function to start rendering a frame of a replay or a daemon, the records
+// of one tick.
+void beginFrame(const Options *options) {
+  if (options->sequential && options->format == FORMAT_SCREEN) {
+    repaintScreen();
+    layoutScreen(options, 1);
+  }
+  for (int i = 0; i < REGISTRY_SIZE; i++) {
+    registry[i].drawn = 0;
+  }
+}
 
-    int memoryPipe[2], usersPipe[2], cpuPipe[2], cpuGraphicalPipe[2];
-    if (pipe(memoryPipe) == -1) {
-      perror("pipe");
-      exit(EXIT_FAILURE);
-    }
-    if (pipe(usersPipe) == -1) {
-      perror("pipe");
-      exit(EXIT_FAILURE);
+// Function to send out a frame once its records are rendered, headless
+// lines are only flushed right away when flush is set.
+void endFrame(const Options *options, int tick, int flush) {
+  if (options->format != FORMAT_SCREEN) {
+    formatTick(tick);
+    if (flush) {
+      flushFormat();
     }
+    return;
+  }
+  if (options->sequential) {
+    redrawIdle();
+  }
+  flushScreen();
+}
 
-    if (pipe(cpuPipe) == -1) {
-      perror("pipe");
-      exit(EXIT_FAILURE);
-    }
+// Helper function that returns the next record of a replay. A merged
+// recording only shows its first input, a screen holds one host.
+static const RecordHeader *nextReplayRecord(Recording *replay) {
+  const RecordHeader *record;
+  while ((record = readRecording(replay)) != NULL && record->reserved != 0) {
+  }
+  return record;
+}
 
-    if (pipe(cpuGraphicalPipe) == -1) {
-      perror("pipe");
-      exit(EXIT_FAILURE);
+// Function to replay a recording through the same rendering as a live run,
+// the sections are laid out from what was recorded. Records of one tick make
+// a frame, frames are paced by their timestamps divided by the speed, or
+// rendered back to back when the speed is 0. A record path writes the
+// records to a new recording as they are rendered.
+void runReplay(Options *options) {
+  Recording replay;
+  openRecording(&replay, options->replayPath);
+  const RecordingHeader *header = replay.header;
+  options->sample = header->sample;
+  options->intervalMs = header->intervalMs;
+  graphicsMode = options->graphics;
+  outputFormat = options->format;
+
+  // The most users seen and the number of cpus size their sections
+  int users = 0, cpus = 1;
+  const RecordHeader *record;
+  while ((record = nextReplayRecord(&replay)) != NULL) {
+    const void *payload = record + 1;
+    if (record->type == RECORD_USERS &&
+        ((const UsersSample *)payload)->count > (uint32_t)users) {
+      users = ((const UsersSample *)payload)->count;
+    } else if (record->type == RECORD_CPU) {
+      cpus = ((const CpuSample *)payload)->num_cpus;
+    } else if (record->type == RECORD_PROCESSES) {
+      options->top = ((const ProcessSample *)payload)->count;
     }
-
-    pid_t memoryPid, usersPid, cpuPid, cpuGraphPid;
-    memoryPid = fork();
-    if (memoryPid == -1) {
-      perror("fork");
-      exit(EXIT_FAILURE);
-    } else if (memoryPid == 0) {  // Child process
-      close(memoryPipe[0]);       // Close unused read end of the pipe
-      dup2(memoryPipe[1],
-           STDOUT_FILENO);   // Redirect stdout to the write end of the pipe
-      close(memoryPipe[1]);  // Close the write end of the pipe in the child
-
-      if (i == 0) {
-        printMemoryGraphical(0.00);
-      } else {
-        printMemoryGraphical(first);
+  }
+  replay.next = 0;
+  layoutSections(options, header->types, header->intervalsMs, users, cpus);
+  if (options->recordPath != NULL) {
+    // Recorded again as it is rendered, e.g. to change its codec
+    startRecordingFile(options);
+    recording.header->start_ns = header->start_ns;
+  }
+  int headless = options->format != FORMAT_SCREEN;
+
+  struct timespec start, now;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  record = nextReplayRecord(&replay);
+  int64_t first_ns = record != NULL ? record->timestamp_ns : 0;
+  while (record != NULL) {
+    if (options->speed > 0) {
+      int64_t due_ns = (int64_t)start.tv_sec * 1000000000 + start.tv_nsec +
+                       (record->timestamp_ns - first_ns) / options->speed;
+      struct timespec due = {due_ns / 1000000000, due_ns % 1000000000};
+      while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, NULL) ==
+             EINTR) {
       }
-      exit(EXIT_SUCCESS);
-    }
-
-    usersPid = fork();
-    if (usersPid == -1) {
-      perror("fork");
-      exit(EXIT_FAILURE);
-    } else if (usersPid == 0) {
-      close(usersPipe[0]);  // Close unused read end of the pipe
-      dup2(usersPipe[1],
-           STDOUT_FILENO);  // Redirect stdout to the write end of the pipe
-      close(usersPipe[1]);  // Close the write end of the pipe in the child
-      printUsers();         // Execute the function in the child process
-      exit(EXIT_SUCCESS);
-    }
-    // Close unnecessary pipe ends in the parent process
-
-    cpuPid = fork();
-    if (cpuPid == -1) {
-      perror("fork");
-      exit(EXIT_FAILURE);
-    } else if (cpuPid == 0) {
-      close(cpuPipe[0]);  // Close unused read end of the pipe
-      dup2(cpuPipe[1],
-           STDOUT_FILENO);  // Redirect stdout to the write end of the pipe
-      close(cpuPipe[1]);    // Close the write end of the pipe in the child
-      printCpu();           // Execute the function in the child process
-      exit(EXIT_SUCCESS);
-    }
-
-    cpuGraphPid = fork();
-    if (cpuGraphPid == -1) {
-      perror("fork");
-      exit(EXIT_FAILURE);
-    } else if (cpuGraphPid == 0) {
-      close(cpuGraphicalPipe[0]);  // Close unused read end of the pipe
-      dup2(cpuGraphicalPipe[1],
-           STDOUT_FILENO);  // Redirect stdout to the write end of the pipe
-      close(cpuGraphicalPipe[1]);  // Close the write end of the pipe in the
-                                   // child
-      printCpuGraphics();          // Execute the function in the child process
-      exit(EXIT_SUCCESS);
-    }
-    // Close unnecessary pipe ends in the parent process
-
-    close(usersPipe[1]);
-    close(memoryPipe[1]);
-    close(cpuPipe[1]);
-    close(cpuGraphicalPipe[1]);
-
-    char buffer[1024];
-    char buffer1[1024];
-    char buffer2[1024];
-    char buffer3[1024];
-    ssize_t nbytes1, nbytes2, nbytes3, nbytes4;
-
-    while ((nbytes1 = read(memoryPipe[0], buffer, sizeof(buffer))) > 0) {
-      // Print the data using printf
-      printf("\033[%d;0H%.*s", 5 + i, (int)nbytes1,
-             buffer);  // Move cursor to the top left corner and then to
-                       // the 17 + i rows down and the first column, then
-                       // print the content
-    }
-
-    while ((nbytes2 = read(usersPipe[0], buffer1, sizeof(buffer1))) > 0) {
-      // Print the data using printf
-      printf("\033[%d;0H%.*s", 7 + sample, (int)nbytes2,
-             buffer1);  // Move cursor to the top left corner and then to
-                        // the 17 + i rows down and the first column, then
-                        // print the content
-    }
-
-    int users = countUsers();
-    while ((nbytes3 = read(cpuPipe[0], buffer2, sizeof(buffer2))) > 0) {
-      // Print the data using printf
-      printf("\033[%d;0H%.*s", users + 8 + sample, (int)nbytes3,
-             buffer2);  // Move cursor to the top left corner and then to
-                        // the 17 + i rows down and the first column, then
-                        // print the content
     }
+    beginFrame(options);
+    int tick = record->tick;
+    do {
+      RegistryEntry *entry = entryForType(record->type);
+      if (entry != NULL) {
+        renderCollector(&entry->collector, record);
+      }
+      record = nextReplayRecord(&replay);
+    } while (record != NULL && record->tick == tick);
+    endFrame(options, tick, options->speed > 0);  // Paced lines go out now
+    replayFrames++;
+  }
+  if (headless) {
+    flushFormat();
+  } else {
+    printf("\033[999B");
+  }
+  if (options->recordPath != NULL) {
+    stopRecording(&recording);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  replaySeconds =
+      now.tv_sec - start.tv_sec + (now.tv_nsec - start.tv_nsec) / 1e9;
+  closeRecording(&replay);
+}
 
-    while ((nbytes4 = read(cpuGraphicalPipe[0], buffer3, sizeof(buffer3))) >
-           0) {
-      // Print the data using printf
-      printf("\033[%d;0H%.*s", users + 10 + sample + i, (int)nbytes4,
-             buffer3);  // Move cursor to the top left corner and then to
-                        // the 17 + i rows down and the first column, then
-                        // print the content
+// Function to render what a collector daemon sends through the same
+// rendering as a replay, from the sections it describes when attaching.
+// Frames are rendered as they arrive until the daemon goes away.
+void runAttach(Options *options) {
+  ViewerHello hello;
+  int fd = attachViewer(options->attachPath, &hello);
+  options->sample = hello.sample;
+  options->intervalMs = hello.intervalMs;
+  options->top = hello.top;
+  graphicsMode = options->graphics;
+  outputFormat = options->format;
+  layoutSections(options, hello.types, hello.intervalsMs, hello.users,
+                 hello.cpus);
+
+  ViewerFrame frame = {NULL, 0, 0};
+  size_t length;
+  while ((length = receiveViewerFrame(fd, &frame)) > 0) {
+    beginFrame(options);
+    int tick = 0;
+    size_t offset = 0;
+    while (offset + sizeof(RecordHeader) <= length) {
+      const RecordHeader *record =
+          (const RecordHeader *)(frame.data + offset);
+      if (record->length > length - offset - sizeof(RecordHeader)) {
+        break;  // Cut short, not from a daemon
+      }
+      RegistryEntry *entry = entryForType(record->type);
+      if (entry != NULL) {
+        renderCollector(&entry->collector, record);
+      }
+      tick = record->tick > tick ? record->tick : tick;
+      offset += viewerRecordSize(record);
     }
+    endFrame(options, tick, 1);
+  }
+  if (options->format == FORMAT_SCREEN) {
+    printf("\033[999B");
+  }
+  free(frame.data);
+  close(fd);
+}
 
-    close(memoryPipe[0]);
-    close(usersPipe[0]);
-    close(cpuPipe[0]);
-    close(cpuGraphicalPipe[0]);
+// Function to print the render throughput of a replay.
+void printReplayStats() {
+  printf("Replayed %ld frames in %.3f s, %.0f frames per second\n",
+         replayFrames, replaySeconds,
+         replaySeconds > 0 ? replayFrames / replaySeconds : 0);
+}
 
-    wait(NULL);
-    wait(NULL);
-    wait(NULL);
-    wait(NULL);
+// Function to print how much of the history is in use and the cpu usage over
+// everything it holds.
+void printHistoryStats() {
+  printf("History: %zu memory and %zu cpu samples of %zu kept, %zu KB\n",
+         memoryHistory.count, cpuHistory.count, memoryHistory.capacity,
+         (historyBytes(&memoryHistory) + historyBytes(&cpuHistory)) / 1024);
+  HistoryStats stats;
+  if (historyWindow(&cpuHistory, CPU_HISTORY_BUSY, INT64_MIN, &stats)) {
+    printf("Cpu use over %zu samples: %.2f%% min, %.2f%% avg, %.2f%% max\n",
+           stats.count, stats.min, stats.avg, stats.max);
+  }
+}
 
-    printf("\033[999B");
-    return;
+// Function to print the snapshot a running monitor publishes, read the way
+// any other local reader would.
+void printSnapshot(const char *name) {
+  const SharedSnapshot *shared = openSnapshot(name);
+  if (shared == NULL) {
+    fprintf(stderr, "%s: no snapshot published\n", name);
+    exit(EXIT_FAILURE);
+  }
+  Snapshot snapshot;
+  uint64_t sequence = readSnapshot(shared, &snapshot);
+  if (sequence == 0) {
+    fprintf(stderr, "%s: %s\n", name,
+            shared->sequence == 0 ? "no sample published yet"
+                                  : "no consistent copy, the writer stalled");
+    closeSnapshot(shared);
+    exit(EXIT_FAILURE);
+  }
+  printf("Snapshot %lu, tick %lu\n", (unsigned long)sequence / 2,
+         (unsigned long)snapshot.tick);
+  if (snapshot.valid & SNAPSHOT_CPU) {
+    printf("cpu %.2f%% busy, %.2f%% iowait, %.2f%% steal over %d cpus\n",
+           snapshot.cpu_busy, snapshot.cpu_iowait, snapshot.cpu_steal,
+           snapshot.num_cpus);
   }
+  if (snapshot.valid & SNAPSHOT_MEMORY) {
+    MemorySample sample;
+    memcpy(sample.kb, snapshot.memory_kb, sizeof(sample.kb));
+    printf("memory %.2f GB used of %lu kB\n", physUsedGb(&sample),
+           (unsigned long)snapshot.memory_kb[MEM_TOTAL]);
+  }
+  if (snapshot.valid & SNAPSHOT_USERS) {
+    printf("users %u\n", snapshot.users);
+  }
+  closeSnapshot(shared);
 }
 
-// Deal with conditionals and print appropriate text
-void printConditionals(int sample, int seconds, int graphics, int system,
-                       int user, int sequential) {
-  if (sequential == 0) {
-    if ((system == 0 && user == 0) || (system == 1 && user == 1)) {
-      printAllInformation(sample, seconds, graphics);
-    } else if (user == 1 && system == 0) {
-      printUserInformation(sample, seconds);
-    } else {
-      printSystemInformation(sample, seconds, graphics);
-    }
-  } else {
-    if ((system == 0 && user == 0) || (system == 1 && user == 1)) {
-      for (int i = 0; i < sample; i++) {
-        printf("\033[1;1H");
-        printAllSeq(sample, seconds, graphics, i);
-
-        // Scroll the content within the scrolling region upward by total_lines
-        // lines
-        printf("\033[999B");
-        sleep(seconds);
+int main(int argc, char **argv) {
+  // query FILE [--from=S] [--to=S] [--metric=a,b] [--summary] aggregates a
+  // recording, from and to are in seconds since the recording started
+  if (argc >= 3 && strcmp(argv[1], "query") == 0) {
+    QueryRange range = {.fromMs = 0, .toMs = -1};
+    for (int n = 3; n < argc; n++) {
+      if (cmpString(argv[n], 8, "--from=")) {
+        range.fromMs = extractPositiveInteger(argv[n]) * 1000LL;
       }
-    } else if (user == 1 && system == 0) {
-      for (int i = 0; i < sample; i++) {
-        printf("\033[1;1H");
-        printUserSeq(sample, seconds);
-
-        // Scroll the content within the scrolling region upward by total_lines
-        // lines
-        printf("\033[999B");
-        sleep(seconds);
+      if (cmpString(argv[n], 6, "--to=")) {
+        range.toMs = extractPositiveInteger(argv[n]) * 1000LL;
       }
-    } else {
-      for (int i = 0; i < sample; i++) {
-        printf("\033[1;1H");
-        printSystemSeq(sample, seconds, graphics, i);
-
-        // Scroll the content within the scrolling region upward by total_lines
-        // lines
-        printf("\033[999B");
-        sleep(seconds);
+      if (cmpString(argv[n], 10, "--metric=")) {
+        range.metrics = argv[n] + strlen("--metric=");
+      }
+      if (strcmp(argv[n], "--summary") == 0) {
+        range.summary = 1;
       }
     }
+    runQuery(argv[2], &range);
+    return 0;
   }
-}
-
-int main(int argc, char **argv) {
-  // Set SIGTSTP signal handler to ignore
-  signal(SIGTSTP, SIG_IGN);
-  signal(SIGINT, sigint_handler);
 
-  printf("\033[2J");    // Clear console
-  printf("\033[1;1H");  // Start at top left
+  // snapshot [NAME] prints what a monitor run with --publish shares
+  if (argc >= 2 && strcmp(argv[1], "snapshot") == 0) {
+    printSnapshot(argc >= 3 ? argv[2] : SNAPSHOT_NAME);
+    return 0;
+  }
 
-  // Case 1: No CLA, print everything, sample size 10, interval 1s
-  if (argc == 1) {
-    printAllInformation(10, 1, 0);
+  // merge [--step=S] [--metric=NAME] [--output=FILE] FILE... merges the
+  // recordings of many hosts, the step takes a unit like the intervals
+  if (argc >= 3 && strcmp(argv[1], "merge") == 0) {
+    MergeOptions merge = {.stepMs = 1000, .metric = findMetric("cpu", 3)};
+    char *paths[argc];
+    int count = 0;
+    for (int n = 2; n < argc; n++) {
+      if (cmpString(argv[n], 8, "--step=")) {
+        merge.stepMs = extractInterval(argv[n]);
+      } else if (cmpString(argv[n], 10, "--metric=")) {
+        const char *name = argv[n] + strlen("--metric=");
+        merge.metric = findMetric(name, strlen(name));
+      } else if (cmpString(argv[n], 10, "--output=")) {
+        merge.outputPath = argv[n] + strlen("--output=");
+      } else {
+        paths[count++] = argv[n];
+      }
+    }
+    if (count == 0 || merge.stepMs <= 0) {
+      fprintf(stderr, "merge needs recordings and a positive step\n");
+      exit(EXIT_FAILURE);
+    }
+    if (merge.outputPath != NULL && count > METRIC_SOURCES) {
+      fprintf(stderr, "merge --output takes at most %d recordings\n",
+              METRIC_SOURCES);
+      exit(EXIT_FAILURE);
+    }
+    runMerge(paths, count, &merge);
+    return 0;
   }
 
-  // CLAs present
-  else {
-    // Default Values
-    int sample = 10;
-    int seconds = 1;
+  // Default Values
+  Options options = {.sample = 10,
+                     .intervalMs = 1000,
+                     .deadlineMs = DEFAULT_DEADLINE_MS,
+                     .historyMb = DEFAULT_HISTORY_MB,
+                     .speed = 1};
+
+  // With no CLA everything is printed, sample size 10, interval 1s
+  if (argc > 1) {
     // Check for positional arguments
     for (int i = 1; i < argc; i++) {
       if (isInteger(argv[i])) {
-        sample = strtol(argv[i], NULL, 10);
+        options.sample = strtol(argv[i], NULL, 10);
         // Check if correct format
-        if (argv[i + 1] == NULL || !isInteger(argv[i + 1])) {
+        // Check if correct format, a zero interval would spin the timer
+        if (argv[i + 1] == NULL || !isInteger(argv[i + 1]) ||
+            strtol(argv[i + 1], NULL, 10) <= 0 ||
+            strtol(argv[i + 1], NULL, 10) > INT_MAX / 1000) {
           printf(
               "Invalid Format, please follow the format x y, where x and y "
               "are "
               "integers indicating sample size and seconds.\n");
-          exit(0);
+          exit(EXIT_FAILURE);
         }
-        seconds = strtol(argv[i + 1], NULL, 10);
+        options.intervalMs = strtol(argv[i + 1], NULL, 10) * 1000;
         break;
       }
     }
 
-    int system = 0;
-    int user = 0;
-    int sequential = 0;
-    int graphics = 0;
     // Check for other flags
     for (int n = 1; n < argc; n++) {
       if (strcmp(argv[n], "--system") == 0) {
-        system = 1;
+        options.system = 1;
       }
       if (strcmp(argv[n], "--user") == 0) {
-        user = 1;
+        options.user = 1;
       }
       if (strcmp(argv[n], "--sequential") == 0) {
-        sequential = 1;
+        options.sequential = 1;
       }
       if (strcmp(argv[n], "--graphics") == 0) {
-        graphics = 1;
+        options.graphics = 1;
+      }
+      if (strcmp(argv[n], "--persistent") == 0) {
+        options.persistent = 1;
+      }
+      if (strcmp(argv[n], "--cores") == 0) {
+        options.cores = 1;
+      }
+      if (strcmp(argv[n], "--cost") == 0) {
+        options.cost = 1;
       }
       if (cmpString(argv[n], 11, "--samples=")) {
-        sample = extractPositiveInteger(argv[n]);
+        options.sample = extractPositiveInteger(argv[n]);
       }
       if (cmpString(argv[n], 10, "--tdelay=")) {
-        seconds = extractPositiveInteger(argv[n]);
+        options.intervalMs = extractInterval(argv[n]);
+      }
+      if (cmpString(argv[n], 12, "--deadline=")) {
+        options.deadlineMs = extractPositiveInteger(argv[n]);
+        if (options.deadlineMs <= 0) {
+          // Every collector would be stale as soon as it is triggered
+          fprintf(stderr, "Invalid deadline %s, use milliseconds above 0\n",
+                  argv[n]);
+          exit(EXIT_FAILURE);
+        }
+      }
+      if (cmpString(argv[n], 10, "--record=")) {
+        options.recordPath = argv[n] + strlen("--record=");
+      }
+      if (strcmp(argv[n], "--compress") == 0) {
+        options.compress = 1;
+      }
+      if (cmpString(argv[n], 10, "--replay=")) {
+        options.replayPath = argv[n] + strlen("--replay=");
+      }
+      if (cmpString(argv[n], 9, "--speed=")) {
+        options.speed = extractPositiveInteger(argv[n]);  // "max" gives 0
+      }
+      if (cmpString(argv[n], 11, "--history=")) {
+        options.historyMb = extractPositiveInteger(argv[n]);
+      }
+      if (strcmp(argv[n], "--publish") == 0) {
+        options.publishName = SNAPSHOT_NAME;
+      }
+      if (cmpString(argv[n], 11, "--publish=")) {
+        options.publishName = argv[n] + strlen("--publish=");
+      }
+      if (cmpString(argv[n], 9, "--serve=")) {
+        options.serveAddress = argv[n] + strlen("--serve=");
+      }
+      if (strcmp(argv[n], "--top") == 0) {
+        options.top = PROCESS_TOP;
+      }
+      if (cmpString(argv[n], 7, "--top=")) {
+        options.top = extractPositiveInteger(argv[n]);
+      }
+      if (cmpString(argv[n], 10, "--daemon=")) {
+        options.daemonPath = argv[n] + strlen("--daemon=");
+      }
+      if (cmpString(argv[n], 10, "--attach=")) {
+        options.attachPath = argv[n] + strlen("--attach=");
+      }
+      if (cmpString(argv[n], 10, "--format=")) {
+        options.format = parseFormat(argv[n] + strlen("--format="));
+      }
+
+      // Per collector intervals, e.g. --cpu-interval=100ms
+      for (int i = 0; i < REGISTRY_SIZE; i++) {
+        char flag[32];
+        int length =
+            snprintf(flag, sizeof(flag), "--%s-interval=", registry[i].name);
+        if (cmpString(argv[n], length + 1, flag)) {
+          registry[i].intervalMs = extractInterval(argv[n]);
+        }
       }
     }
-    printConditionals(sample, seconds, graphics, system, user, sequential);
   }
-  // Move cursor to the bottom to not overlap with printed information.
-  printf("\033[999;1H");
+  // Headless formats leave the terminal alone and stdout to the records, a
+  // daemon leaves the terminal to its viewers
+  int live = options.replayPath == NULL && options.attachPath == NULL;
+  int headless = options.format != FORMAT_SCREEN;
+  int terminal = !headless && !(live && options.daemonPath != NULL);
+  if (headless) {
+    startFormat(options.format);
+  } else if (terminal) {
+    // Set SIGTSTP signal handler to ignore
+    signal(SIGTSTP, SIG_IGN);
+    signal(SIGINT, sigint_handler);
+
+    printf("\033[2J");    // Clear console
+    printf("\033[1;1H");  // Start at top left
+    initCharts();
+  }
+  if (options.replayPath != NULL) {
+    runReplay(&options);
+  } else if (options.attachPath != NULL) {
+    runAttach(&options);
+  } else {
+    runMonitor(&options);
+  }
+
+  if (headless) {
+    // Statistics go to stderr, stdout only holds records
+    fflush(stdout);
+    dup2(STDERR_FILENO, STDOUT_FILENO);
+  } else if (terminal) {
+    // Move cursor to the bottom to not overlap with printed information.
+    printf("\033[999;1H");
+  }
+  if (options.replayPath != NULL) {
+    printReplayStats();
+    if (!headless) {
+      printScreenStats();
+    }
+  }
+  if (options.attachPath != NULL && !headless) {
+    printScreenStats();
+  }
+  if (options.cost && live) {
+    printCollectorCost(options.persistent);
+    printSchedulerStats(&scheduler);
+    printHistoryStats();
+    if (terminal) {
+      printScreenStats();
+    }
+  }
+  if (options.serveAddress != NULL && live) {
+    printServerStats(&server);
+  }
+  if (options.daemonPath != NULL && live) {
+    printViewerStats(&viewers);
+  }
+  if (options.recordPath != NULL) {
+    printRecordingStats(&recording);
+    printRollupStats(&rollups);
+    closeRollups(&rollups);
+  }
+  freeHistory(&memoryHistory);
+  freeHistory(&cpuHistory);
+  freeScreen();
 
   return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,234 @@
+#define _GNU_SOURCE  // accept4
+
+#include "viewers.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Helper function to make room for size bytes in a frame.
+static void reserveFrame(ViewerFrame *frame, size_t size) {
+  if (size <= frame->capacity) {
+    return;
+  }
+  size_t capacity = frame->capacity ? frame->capacity : 4096;
+  while (capacity < size) {
+    capacity *= 2;
+  }
+  frame->data = realloc(frame->data, capacity);
+  if (frame->data == NULL) {
+    perror("realloc");
+    exit(EXIT_FAILURE);
+  }
+  frame->capacity = capacity;
+}
+
+// Helper function to add length bytes at the end of a frame.
+static void appendFrame(ViewerFrame *frame, const void *data, size_t length) {
+  if (length == 0) {
+    return;
+  }
+  reserveFrame(frame, frame->length + length);
+  memcpy(frame->data + frame->length, data, length);
+  frame->length += length;
+}
+
+// Helper function to fill in the address of a unix socket.
+static void socketAddress(struct sockaddr_un *address, const char *path) {
+  memset(address, 0, sizeof(*address));
+  address->sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(address->sun_path)) {
+    fprintf(stderr, "%s: path too long\n", path);
+    exit(EXIT_FAILURE);
+  }
+  strcpy(address->sun_path, path);
+}
+
+// Helper function to send one message to a viewer without waiting, returns
+// 1 when it went out whole. Sequenced packets are never split, the socket
+// either takes the whole message or none of it.
+static int sendViewer(int fd, const void *data, size_t length) {
+  return send(fd, data, length, MSG_DONTWAIT | MSG_NOSIGNAL) ==
+         (ssize_t)length;
+}
+
+// Function to listen for viewers on a unix socket. Every viewer first gets
+// hello, then the frames sent from then on.
+void startViewers(Viewers *viewers, const char *path,
+                  const ViewerHello *hello) {
+  memset(viewers, 0, sizeof(*viewers));
+  for (int i = 0; i < VIEWER_CLIENTS; i++) {
+    viewers->clients[i] = -1;
+  }
+  viewers->path = path;
+  viewers->hello = *hello;
+  memcpy(viewers->hello.magic, VIEWER_MAGIC, sizeof(viewers->hello.magic));
+  viewers->hello.version = VIEWER_VERSION;
+
+  struct sockaddr_un local;
+  socketAddress(&local, path);
+  unlink(path);  // Left behind by an earlier run
+  viewers->listenFd =
+      socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (viewers->listenFd == -1 ||
+      bind(viewers->listenFd, (struct sockaddr *)&local, sizeof(local)) ==
+          -1 ||
+      listen(viewers->listenFd, VIEWER_CLIENTS) == -1) {
+    perror(path);
+    exit(EXIT_FAILURE);
+  }
+}
+
+// Function to take in the viewers waiting to attach. A new viewer gets the
+// hello and then the last record of every type as its first frame, so
+// sections sampled rarely or once show up right away. Run by the scheduler
+// when the listening socket is readable.
+void acceptViewers(void *context) {
+  Viewers *viewers = context;
+  int fd;
+  while ((fd = accept4(viewers->listenFd, NULL, NULL,
+                       SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1) {
+    int slot = 0;
+    while (slot < VIEWER_CLIENTS && viewers->clients[slot] != -1) {
+      slot++;
+    }
+    if (slot == VIEWER_CLIENTS) {
+      close(fd);
+      viewers->refused++;
+      continue;
+    }
+
+    ViewerFrame first = {NULL, 0, 0};
+    for (int type = 0; type < RECORDING_TYPES; type++) {
+      appendFrame(&first, viewers->latest[type].data,
+                  viewers->latest[type].length);
+    }
+    // A fresh socket's buffer takes both
+    if (!sendViewer(fd, &viewers->hello, sizeof(viewers->hello)) ||
+        (first.length > 0 && !sendViewer(fd, first.data, first.length))) {
+      close(fd);
+    } else {
+      viewers->clients[slot] = fd;
+      viewers->attached++;
+    }
+    free(first.data);
+  }
+}
+
+// Function that returns the bytes a record takes in a frame, padded so the
+// next record is aligned.
+size_t viewerRecordSize(const RecordHeader *record) {
+  size_t size = sizeof(RecordHeader) + record->length;
+  return (size + VIEWER_ALIGN - 1) / VIEWER_ALIGN * VIEWER_ALIGN;
+}
+
+// Function to add a record to the frame of the current tick.
+void addViewerRecord(Viewers *viewers, const RecordHeader *record) {
+  static const char padding[VIEWER_ALIGN];
+  size_t size = sizeof(RecordHeader) + record->length;
+  size_t padded = viewerRecordSize(record);
+  appendFrame(&viewers->frame, record, size);
+  appendFrame(&viewers->frame, padding, padded - size);
+  if (record->type < RECORDING_TYPES) {
+    viewers->latest[record->type].length = 0;
+    appendFrame(&viewers->latest[record->type], record, size);
+    appendFrame(&viewers->latest[record->type], padding, padded - size);
+  }
+}
+
+// Function to send the frame of the current tick to every viewer and start
+// the next one. A viewer whose socket is full misses the frame, one that
+// went away is dropped. Records are whole samples, so a viewer computes the
+// same cpu usage over a longer interval after missing frames.
+void sendViewerFrame(Viewers *viewers) {
+  if (viewers->frame.length == 0) {
+    return;
+  }
+  viewers->frames++;
+  for (int i = 0; i < VIEWER_CLIENTS; i++) {
+    int fd = viewers->clients[i];
+    if (fd == -1) {
+      continue;
+    }
+    if (sendViewer(fd, viewers->frame.data, viewers->frame.length)) {
+      viewers->sent++;
+    } else if (errno == EAGAIN || errno == ENOBUFS) {
+      viewers->dropped++;
+    } else {
+      close(fd);
+      viewers->clients[i] = -1;
+    }
+  }
+  viewers->frame.length = 0;
+}
+
+// Function to detach every viewer and remove the socket.
+void stopViewers(Viewers *viewers) {
+  for (int i = 0; i < VIEWER_CLIENTS; i++) {
+    if (viewers->clients[i] != -1) {
+      close(viewers->clients[i]);
+    }
+  }
+  close(viewers->listenFd);
+  unlink(viewers->path);
+  free(viewers->frame.data);
+  for (int type = 0; type < RECORDING_TYPES; type++) {
+    free(viewers->latest[type].data);
+  }
+}
+
+// Function to print how many viewers attached and how many frames they got.
+void printViewerStats(const Viewers *viewers) {
+  printf("Viewers: %lu attached, %lu refused, %lu frames, %lu sent, "
+         "%lu dropped\n",
+         (unsigned long)viewers->attached, (unsigned long)viewers->refused,
+         (unsigned long)viewers->frames, (unsigned long)viewers->sent,
+         (unsigned long)viewers->dropped);
+}
+
+// Function to attach to a collector daemon, filling in its hello. Returns
+// the socket frames arrive on.
+int attachViewer(const char *path, ViewerHello *hello) {
+  struct sockaddr_un remote;
+  socketAddress(&remote, path);
+  int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if (fd == -1 ||
+      connect(fd, (struct sockaddr *)&remote, sizeof(remote)) == -1) {
+    perror(path);
+    exit(EXIT_FAILURE);
+  }
+  ssize_t nbytes;
+  while ((nbytes = recv(fd, hello, sizeof(*hello), 0)) == -1 &&
+         errno == EINTR) {
+  }
+  if (nbytes != sizeof(*hello) ||
+      memcmp(hello->magic, VIEWER_MAGIC, sizeof(hello->magic)) != 0 ||
+      hello->version != VIEWER_VERSION) {
+    fprintf(stderr, "%s: not a collector daemon\n", path);
+    exit(EXIT_FAILURE);
+  }
+  return fd;
+}
+
+// Function to wait for the next frame, growing its buffer to fit. Returns
+// its length, 0 once the daemon went away.
+size_t receiveViewerFrame(int fd, ViewerFrame *frame) {
+  ssize_t length;
+  while ((length = recv(fd, NULL, 0, MSG_PEEK | MSG_TRUNC)) == -1 &&
+         errno == EINTR) {
+  }
+  if (length <= 0) {
+    return 0;
+  }
+  reserveFrame(frame, length);
+  ssize_t nbytes;
+  while ((nbytes = recv(fd, frame->data, length, 0)) == -1 &&
+         errno == EINTR) {
+  }
+  frame->length = nbytes > 0 ? nbytes : 0;
+  return frame->length;
+}
@@ -0,0 +1,65 @@
+#ifndef VIEWERS_H
+#define VIEWERS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "collectors.h"
+#include "recording.h"
+
+#define VIEWER_MAGIC "SYSMONVW"
+#define VIEWER_VERSION 1
+#define VIEWER_CLIENTS 16  // Viewers attached at once, more are refused
+#define VIEWER_ALIGN 8     // Records in a frame start at multiples of this
+
+// First message a viewer gets, what it needs to lay out its screen the way
+// a replay does from a recording header
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  int32_t sample;
+  int32_t intervalMs;
+  uint32_t types;                        // Bit n set when type n is sent
+  int32_t intervalsMs[RECORDING_TYPES];  // Per type, -1 for sampled once
+  uint32_t users;                        // Rows of the sessions section
+  uint32_t cpus;
+  uint32_t top;  // Processes listed per ranking
+} ViewerHello;
+
+// Growable run of whole records, one tick's worth makes a frame. Each
+// record takes viewerRecordSize() bytes.
+typedef struct {
+  char *data;
+  size_t length;
+  size_t capacity;
+} ViewerFrame;
+
+// Collector daemon side of the viewer socket. Every tick's records go to
+// every viewer as one message, a viewer too slow to take it misses that
+// frame instead of holding the collectors back.
+typedef struct {
+  int listenFd;
+  const char *path;  // Unix socket, removed when stopping
+  ViewerHello hello;
+  int clients[VIEWER_CLIENTS];
+  ViewerFrame frame;                    // Records of the current tick
+  ViewerFrame latest[RECORDING_TYPES];  // Last record of every type
+  uint64_t frames;
+  uint64_t attached;
+  uint64_t refused;
+  uint64_t sent;
+  uint64_t dropped;
+} Viewers;
+
+// Function prototypes
+void startViewers(Viewers *viewers, const char *path,
+                  const ViewerHello *hello);
+void acceptViewers(void *context);
+size_t viewerRecordSize(const RecordHeader *record);
+void addViewerRecord(Viewers *viewers, const RecordHeader *record);
+void sendViewerFrame(Viewers *viewers);
+void stopViewers(Viewers *viewers);
+void printViewerStats(const Viewers *viewers);
+int attachViewer(const char *path, ViewerHello *hello);
+size_t receiveViewerFrame(int fd, ViewerFrame *frame);
+#endif  // VIEWERS_H